@@ -0,0 +1,151 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   loadgen.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/30 17:25:09 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/30 17:25:09 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Minimal keep-alive HTTP load generator used by bench/run.sh.
+** Usage: loadgen <port> <connections> <seconds> <path>
+** Every connection sends one GET, reads the full response and repeats.
+** Responses without Content-Length are read until the peer closes,
+** after which the connection is reopened. A close between two responses
+** (keep-alive limit reached) only reopens the connection.
+*/
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+struct Conn
+{
+	int			fd = -1;
+	std::string	in;
+	size_t		expected = 0;
+	bool		untilClose = false;
+};
+
+static int			g_port;
+static std::string	g_request;
+
+static int openConn(int epfd, Conn& c)
+{
+	sockaddr_in	addr{};
+
+	c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(g_port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	connect(c.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+	c.in.clear();
+	c.expected = 0;
+	c.untilClose = false;
+	epoll_event ev{};
+	ev.events = EPOLLOUT;
+	ev.data.ptr = &c;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+}
+
+static void waitFor(int epfd, Conn& c, uint32_t events)
+{
+	epoll_event ev{};
+	ev.events = events;
+	ev.data.ptr = &c;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+/* Returns true once a whole response sits in c.in */
+static bool responseComplete(Conn& c)
+{
+	if (c.expected == 0 && !c.untilClose)
+	{
+		size_t end = c.in.find("\r\n\r\n");
+		if (end == std::string::npos)
+			return false;
+		size_t cl = c.in.find("Content-Length:");
+		if (cl == std::string::npos || cl > end)
+			cl = c.in.find("content-length:");
+		if (cl == std::string::npos || cl > end)
+		{
+			c.untilClose = true;
+			return false;
+		}
+		c.expected = end + 4 + std::strtoul(c.in.c_str() + cl + 15, nullptr, 10);
+	}
+	return !c.untilClose && c.in.size() >= c.expected;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 5)
+	{
+		std::fprintf(stderr, "usage: %s <port> <connections> <seconds> <path>\n", argv[0]);
+		return 1;
+	}
+	g_port = std::atoi(argv[1]);
+	int		count = std::atoi(argv[2]);
+	double	seconds = std::atof(argv[3]);
+	g_request = std::string("GET ") + argv[4] + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+	int					epfd = epoll_create1(0);
+	std::vector<Conn>	conns(count);
+	for (Conn& c : conns)
+		openConn(epfd, c);
+
+	using clock = std::chrono::steady_clock;
+	auto		stop = clock::now() + std::chrono::duration<double>(seconds);
+	size_t		done = 0, errors = 0;
+	char		buf[65536];
+	epoll_event	events[256];
+
+	while (clock::now() < stop)
+	{
+		int n = epoll_wait(epfd, events, 256, 100);
+		for (int i = 0; i < n; i++)
+		{
+			Conn& c = *static_cast<Conn*>(events[i].data.ptr);
+			if (events[i].events & EPOLLOUT)
+			{
+				if (send(c.fd, g_request.data(), g_request.size(), MSG_NOSIGNAL) < 0)
+					errors++;
+				waitFor(epfd, c, EPOLLIN);
+				continue;
+			}
+			ssize_t r = recv(c.fd, buf, sizeof(buf), 0);
+			if (r > 0)
+				c.in.append(buf, r);
+			if (r > 0 && responseComplete(c))
+			{
+				done++;
+				c.in.erase(0, c.expected);
+				c.expected = 0;
+				waitFor(epfd, c, EPOLLOUT);
+			}
+			else if (r <= 0)
+			{
+				if (c.untilClose && r == 0)
+					done++;
+				else if (r < 0 || !c.in.empty())
+					errors++;
+				close(c.fd);
+				openConn(epfd, c);
+			}
+		}
+	}
+	std::printf("%.0f req/s (%zu requests, %zu errors)\n", done / seconds, done, errors);
+	return 0;
+}
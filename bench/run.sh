@@ -0,0 +1,43 @@
+#!/bin/bash
+# Compares the event loop backends on a static file and a CGI script.
+# Usage: bench/run.sh [connections] [seconds]
+# Builds webserv with the io_uring backend (make URING=1), bench/loadgen and
+# bench/syscount. A last pass on the static file traces the server with
+# ptrace to count its syscalls per request, which makes that pass slow.
+
+cd "$(dirname "$0")/.." || exit 1
+CONNS=${1:-64}
+SECS=${2:-5}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+make -s URING=1 || exit 1
+c++ -O2 -std=c++17 bench/loadgen.cpp -o "$TMP/loadgen" || exit 1
+c++ -O2 -std=c++17 bench/syscount.cpp -o "$TMP/syscount" || exit 1
+
+for backend in poll epoll io_uring; do
+	cat > "$TMP/bench.conf" <<CONF
+[main]
+eventLoop $backend
+py /usr/bin/python3
+
+[server]
+ipAddress 127.0.0.1
+port 8005
+serverName bench
+
+[location]
+path /
+root webroot/website0/
+CONF
+	./webserv "$TMP/bench.conf" > "$TMP/server.log" 2>&1 &
+	PID=$!
+	sleep 0.5
+	printf '%-9s static  ' "$backend"; "$TMP/loadgen" 8005 "$CONNS" "$SECS" /favicon.ico
+	printf '%-9s cgi     ' "$backend"; "$TMP/loadgen" 8005 8 "$SECS" /cgi-bin/hello.py
+	requests=$("$TMP/syscount" $PID "$TMP/loadgen" 8005 "$CONNS" "$SECS" /favicon.ico 2> "$TMP/syscalls" \
+		| sed -n 's/.*(\([0-9]*\) requests.*/\1/p')
+	printf '%-9s syscall %s/request %s\n' "$backend" \
+		"$(awk -v r="$requests" '{ printf "%.1f", $1 / (r ? r : 1) }' "$TMP/syscalls")" "$(cut -d' ' -f3- "$TMP/syscalls")"
+	kill -TERM $PID; wait $PID 2>/dev/null
+done
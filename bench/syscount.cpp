@@ -0,0 +1,144 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   syscount.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/03 15:36:11 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/03 15:36:11 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Counts the syscalls a running process makes while a command runs, used by
+** bench/run.sh to compare the event loop backends per request.
+** Usage: syscount <pid> <command> [args...]
+** Every thread of <pid> is traced with ptrace(PTRACE_SEIZE), which slows it
+** down a lot, so only the counts are meaningful. The command's output is left
+** as is, the counts go to stderr as "<total> syscalls (<top ones>)".
+** Tracing stops when the command exits, the tracees are detached on exit.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <map>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static std::string syscallName(long nr)
+{
+	switch (nr)
+	{
+		case SYS_read: return "read";
+		case SYS_write: return "write";
+		case SYS_writev: return "writev";
+		case SYS_sendfile: return "sendfile";
+		case SYS_accept4: return "accept4";
+		case SYS_close: return "close";
+		case SYS_access: return "access";
+		case SYS_brk: return "brk";
+		case SYS_openat: return "openat";
+		case SYS_statx: return "statx";
+		case SYS_newfstatat: return "newfstatat";
+		case SYS_fstat: return "fstat";
+		case SYS_setsockopt: return "setsockopt";
+		case SYS_poll: return "poll";
+		case SYS_epoll_wait: return "epoll_wait";
+		case SYS_epoll_ctl: return "epoll_ctl";
+		case SYS_io_uring_enter: return "io_uring_enter";
+		case SYS_clock_gettime: return "clock_gettime";
+		case SYS_fadvise64: return "fadvise64";
+		default: return "#" + std::to_string(nr);
+	}
+}
+
+/* Seizes every thread of the process, threads started later follow through PTRACE_O_TRACECLONE */
+static bool seizeThreads(pid_t pid)
+{
+	std::string path = "/proc/" + std::to_string(pid) + "/task";
+	DIR* dir = opendir(path.c_str());
+	if (!dir)
+		return false;
+	size_t seized = 0;
+	while (struct dirent* entry = readdir(dir))
+	{
+		if (entry->d_name[0] == '.')
+			continue ;
+		pid_t tid = atoi(entry->d_name);
+		if (ptrace(PTRACE_SEIZE, tid, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE) == 0
+			&& ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) == 0)
+			seized++;
+	}
+	closedir(dir);
+	return seized > 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <pid> <command> [args...]\n", argv[0]);
+		return 1;
+	}
+	pid_t target = atoi(argv[1]);
+	if (!seizeThreads(target))
+	{
+		perror("ptrace");
+		return 1;
+	}
+
+	pid_t command = fork();
+	if (command == 0)
+	{
+		execvp(argv[2], argv + 2);
+		perror("execvp");
+		_exit(127);
+	}
+
+	std::map<long, size_t> counts;
+	size_t total = 0;
+	int status;
+	pid_t tid;
+	while ((tid = waitpid(-1, &status, __WALL)) > 0)
+	{
+		if (tid == command)
+		{
+			if (WIFEXITED(status) || WIFSIGNALED(status))
+				break ;
+			continue ;
+		}
+		if (!WIFSTOPPED(status))
+			continue ;
+		int signal = 0;
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+		{
+			struct __ptrace_syscall_info info;
+			if (ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info) > 0
+				&& info.op == PTRACE_SYSCALL_INFO_ENTRY)
+			{
+				counts[info.entry.nr]++;
+				total++;
+			}
+		}
+		else if (status >> 16 == 0 && WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP)
+			signal = WSTOPSIG(status);
+		ptrace(PTRACE_SYSCALL, tid, nullptr, signal);
+	}
+
+	std::vector<std::pair<size_t, long>> top;
+	for (const auto& entry : counts)
+		top.push_back({entry.second, entry.first});
+	std::sort(top.rbegin(), top.rend());
+	std::string summary;
+	for (size_t i = 0; i < top.size() && i < 5; i++)
+		summary += (i ? ", " : "") + syscallName(top[i].second) + " " + std::to_string(top[i].first);
+	fprintf(stderr, "%zu syscalls (%s)\n", total, summary.c_str());
+	return 0;
+}
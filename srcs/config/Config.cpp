@@ -6,11 +6,12 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:08:24 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/02 15:26:31 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/03 10:17:52 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "Config.hpp"
+#include "../response/HeaderWriter.hpp"
 
 Config::Config(std::string filePath, const char* argv0)
 {
@@ -45,6 +46,14 @@ void Config::printConfig()
 	int i = 0;
 
 	LOG_DEBUG(BG_YELLOW, TEXT_BLACK, TEXT_BOLD, "Main config", i, RESET);
+	LOG_DEBUG(TEXT_YELLOW, "\teventLoop: ", _mainConfig.eventLoop, RESET);
+	LOG_DEBUG(TEXT_YELLOW, "\tedgeTriggered: ", std::boolalpha, _mainConfig.edgeTriggered, RESET);
+	LOG_DEBUG(TEXT_YELLOW, "\tworkers: ", _mainConfig.workers, RESET);
+	LOG_DEBUG(TEXT_YELLOW, "\tthreads: ", _mainConfig.threads, RESET);
+	LOG_DEBUG(TEXT_YELLOW, "\tfileCacheSize: ", _mainConfig.fileCacheSize, RESET);
+	LOG_DEBUG(TEXT_YELLOW, "\tclientBodyTempPath: ", _mainConfig.clientBodyTempPath, RESET);
+	for (int cpu : _mainConfig.workerCpuAffinity)
+		LOG_DEBUG(TEXT_YELLOW, "\tworkerCpuAffinity: ", cpu, RESET);
 	for (auto& [cgiName, cgiPath] : _cgis)
 	{
 		LOG_DEBUG(TEXT_YELLOW, "\t", cgiName, ": ", cgiPath, RESET);
@@ -63,6 +72,17 @@ void Config::printConfig()
 			LOG_DEBUG(TEXT_YELLOW, "\tport: ", server.port, RESET);
 			LOG_DEBUG(TEXT_YELLOW, "\tserverName: ", server.serverName, RESET);
 			LOG_DEBUG(TEXT_YELLOW, "\tclientMaxBodySize: ", server.clientMaxBodySize, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\tclientBodyBufferSize: ", server.clientBodyBufferSize, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\tkeepaliveTimeout: ", server.keepaliveTimeout, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\tkeepaliveRequests: ", server.keepaliveRequests, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\theaderTimeout: ", server.headerTimeout, ", bodyTimeout: ", server.bodyTimeout,
+				", bodyMinRate: ", server.bodyMinRate, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\tcgiTimeout: ", server.cgiTimeout, ", sendTimeout: ", server.sendTimeout, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\tlistenBacklog: ", server.socketOptions.listenBacklog, ", tcpNoDelay: ", std::boolalpha,
+				server.socketOptions.tcpNoDelay, ", tcpCork: ", server.socketOptions.tcpCork, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\ttcpDeferAccept: ", server.socketOptions.tcpDeferAccept, ", tcpFastOpen: ",
+				server.socketOptions.tcpFastOpen, ", sendBufferSize: ", server.socketOptions.sendBufferSize, RESET);
+			LOG_DEBUG(TEXT_YELLOW, "\treceiveBufferSize: ", server.socketOptions.receiveBufferSize, RESET);
 			for (auto& error : server.defaultPages)
 				LOG_DEBUG(TEXT_YELLOW, "\tdefaultError: ", error.first, " ", error.second, RESET);
 			for (auto& error : server.errorPages)
@@ -77,6 +97,13 @@ void Config::printConfig()
 				LOG_DEBUG(TEXT_YELLOW, "\t\tupload: ", location.upload, RESET);
 				LOG_DEBUG(TEXT_YELLOW, "\t\tautoindex: ", std::boolalpha, location.autoindex, RESET);
 				LOG_DEBUG(TEXT_YELLOW, "\t\tindex: ", location.index, RESET);
+				LOG_DEBUG(TEXT_YELLOW, "\t\tsendfileThreshold: ", location.sendfileThreshold, RESET);
+				LOG_DEBUG(TEXT_YELLOW, "\t\tgzip: ", std::boolalpha, location.gzip, RESET);
+				LOG_DEBUG(TEXT_YELLOW, "\t\tgzipMinLength: ", location.gzipMinLength, RESET);
+				LOG_DEBUG(TEXT_YELLOW, "\t\tgzipMaxLength: ", location.gzipMaxLength, RESET);
+				LOG_DEBUG(TEXT_YELLOW, "\t\tgzipLevel: ", location.gzipLevel, RESET);
+				for (auto& type : location.gzipTypes)
+					LOG_DEBUG(TEXT_YELLOW, "\t\tgzipType: ", type, RESET);
 				for (auto& method : location.methods)
 				{
 					if (method.second)
@@ -185,6 +212,7 @@ void Config::parse()
 	/* Filter out invalid server configs */
 	serverStringsVec = filterOutInvalidServerStrings(serverStringsVec);
 	parseServers(serverStringsVec);
+	compilePages();
 
 	LOG_INFO("Config file parsed");
 }
@@ -202,7 +230,33 @@ void Config::parseMainConfig(std::string mainConfig)
 			line = Utility::trim(line);
 			if (line.empty()) continue;
 			std::vector<std::string> lineSplit = Utility::splitStr(line, " ");
-			if (lineSplit.size() == 2)
+			if (lineSplit.size() != 2)
+				continue;
+			if (lineSplit[0] == "eventLoop")
+				_mainConfig.eventLoop = lineSplit[1];
+			else if (lineSplit[0] == "edgeTriggered")
+				_mainConfig.edgeTriggered = lineSplit[1] == "on";
+			else if (lineSplit[0] == "workers")
+				_mainConfig.workers = lineSplit[1] == "auto" ? Utility::countOnlineCpus() : std::stoi(lineSplit[1]);
+			else if (lineSplit[0] == "threads")
+				_mainConfig.threads = lineSplit[1] == "auto" ? Utility::countOnlineCpus() : std::stoi(lineSplit[1]);
+			else if (lineSplit[0] == "workerCpuAffinity")
+			{
+				for (std::string& cpu : Utility::splitStr(lineSplit[1], ","))
+					_mainConfig.workerCpuAffinity.push_back(std::stoi(cpu));
+			}
+			else if (lineSplit[0] == "fileCacheSize")
+				_mainConfig.fileCacheSize = lineSplit[1] == "off" ? 0 : Utility::sizeToBytes(lineSplit[1]);
+			else if (lineSplit[0] == "clientBodyTempPath")
+			{
+				// Spooled bodies are created in the directory, a path where they can not be is refused here
+				if (access(lineSplit[1].c_str(), W_OK | X_OK) == 0)
+					_mainConfig.clientBodyTempPath = lineSplit[1];
+				else
+					LOG_WARNING("clientBodyTempPath \"", lineSplit[1], "\" is not writable, ",
+						_mainConfig.clientBodyTempPath, " is used");
+			}
+			else
 				_cgis[lineSplit[0]] = normalizeFilePath(lineSplit[1], false);
 		}
 	}
@@ -259,6 +313,36 @@ void Config::parseServers(std::vector<std::string> serverStringsVec)
 			}
 			else if (key == "clientMaxBodySize")
 				serverConfig.clientMaxBodySize = value;
+			else if (key == "clientBodyBufferSize")
+				serverConfig.clientBodyBufferSize = value;
+			else if (key == "keepaliveTimeout")
+				serverConfig.keepaliveTimeout = std::stoi(value);
+			else if (key == "keepaliveRequests")
+				serverConfig.keepaliveRequests = std::stoi(value);
+			else if (key == "headerTimeout")
+				serverConfig.headerTimeout = std::stoi(value);
+			else if (key == "bodyTimeout")
+				serverConfig.bodyTimeout = std::stoi(value);
+			else if (key == "bodyMinRate")
+				serverConfig.bodyMinRate = std::stoi(value);
+			else if (key == "cgiTimeout")
+				serverConfig.cgiTimeout = std::stoi(value);
+			else if (key == "sendTimeout")
+				serverConfig.sendTimeout = std::stoi(value);
+			else if (key == "listenBacklog")
+				serverConfig.socketOptions.listenBacklog = std::stoi(value);
+			else if (key == "tcpNoDelay")
+				serverConfig.socketOptions.tcpNoDelay = value == "on";
+			else if (key == "tcpCork")
+				serverConfig.socketOptions.tcpCork = value == "on";
+			else if (key == "tcpDeferAccept")
+				serverConfig.socketOptions.tcpDeferAccept = std::stoi(value);
+			else if (key == "tcpFastOpen")
+				serverConfig.socketOptions.tcpFastOpen = std::stoi(value);
+			else if (key == "sendBufferSize")
+				serverConfig.socketOptions.sendBufferSize = std::stoi(value);
+			else if (key == "receiveBufferSize")
+				serverConfig.socketOptions.receiveBufferSize = std::stoi(value);
 			else if (key == "error")
 			{
 				std::vector<std::string> errorCodesString = Utility::splitStr(value, ",");
@@ -296,7 +380,7 @@ void Config::parseServers(std::vector<std::string> serverStringsVec)
 }
 
 
-fs::path Config::getExecutablePath()
+fs::path Config::getExecutablePath() const
 {
 	fs::path executablePath = fs::current_path() / _argv0;
 		
@@ -309,7 +393,7 @@ fs::path Config::getExecutablePath()
 	return executablePath.parent_path();
 }
 
-std::string Config::normalizeFilePath(std::string filePathStr, bool closePath)
+std::string Config::normalizeFilePath(std::string filePathStr, bool closePath) const
 {
 	try
 	{
@@ -364,6 +448,22 @@ void Config::parseLocations(ServerConfig& serverConfig, std::vector<std::string>
 						serverConfig.locations[j].autoindex = true;
 				else if (key == "index")
 						serverConfig.locations[j].index = value;
+				else if (key == "sendfileThreshold")
+					serverConfig.locations[j].sendfileThreshold = value == "off"
+						? std::numeric_limits<size_t>::max() : Utility::sizeToBytes(value);
+				else if (key == "gzip")
+					serverConfig.locations[j].gzip = value == "on";
+				else if (key == "gzipTypes")
+				{
+					std::vector<std::string> types = Utility::splitStr(value, ",");
+					serverConfig.locations[j].gzipTypes = std::set<std::string>(types.begin(), types.end());
+				}
+				else if (key == "gzipMinLength")
+					serverConfig.locations[j].gzipMinLength = Utility::sizeToBytes(value);
+				else if (key == "gzipMaxLength")
+					serverConfig.locations[j].gzipMaxLength = Utility::sizeToBytes(value);
+				else if (key == "gzipLevel")
+					serverConfig.locations[j].gzipLevel = std::stoi(value);
 				else if (key == "methods")
 				{
 					for (auto& methodPair : serverConfig.locations[j].methods)
@@ -378,12 +478,65 @@ void Config::parseLocations(ServerConfig& serverConfig, std::vector<std::string>
 		}
 }
 
-std::map<std::string, std::vector<ServerConfig>>& Config::getServersConfigsMap()
+/**
+ * Reads the error and default pages of every server once, so an error response
+ * shares bytes already in memory instead of reading the disk. A page shared by
+ * several servers is read only once. Unreadable pages are left out and fall
+ * back to the last resort bodies at response time
+ */
+void Config::compilePages()
+{
+	std::map<std::string, CompiledPage> loaded;
+
+	for (auto& [ipPort, serverConfigs] : _serversConfigsMap)
+	{
+		for (ServerConfig& serverConfig : serverConfigs)
+		{
+			std::map<int, std::string> pages = serverConfig.defaultPages;
+			for (auto& [code, path] : serverConfig.errorPages)
+			{
+				if (access(path.c_str(), R_OK) == 0)
+					pages[code] = path;
+			}
+			for (auto& [code, path] : pages)
+			{
+				auto it = loaded.find(path);
+				if (it == loaded.end())
+				{
+					try
+					{
+						size_t dotPos = path.find_last_of(".");
+						std::string_view extension = dotPos == std::string::npos
+							? std::string_view() : std::string_view(path).substr(dotPos + 1);
+						CompiledPage page = {std::make_shared<const std::string>(Utility::readBinaryFile(path)),
+							std::string(HeaderWriter::mimeType(extension))};
+						it = loaded.emplace(path, std::move(page)).first;
+					}
+					catch (const std::exception& e)
+					{
+						LOG_WARNING("Page \"", path, "\" can not be loaded");
+						it = loaded.emplace(path, CompiledPage()).first;
+					}
+				}
+				if (it->second.body)
+					serverConfig.compiledPages[code] = it->second;
+			}
+		}
+	}
+	LOG_DEBUG(loaded.size(), " error and default pages loaded");
+}
+
+const std::map<std::string, std::vector<ServerConfig>>& Config::getServersConfigsMap() const
 {
 	return _serversConfigsMap;
 }
 
-std::list<std::string>& Config::getServersConfigsMapKeys()
+const std::list<std::string>& Config::getServersConfigsMapKeys() const
 {
 	return _serversConfigsMapKeys;
-}
\ No newline at end of file
+}
+
+const MainConfig& Config::getMainConfig() const
+{
+	return _mainConfig;
+}
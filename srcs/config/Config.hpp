@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:08:20 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/08 13:46:36 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/10/03 10:17:52 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -23,6 +23,9 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <memory>
+#include <set>
+#include <limits>
 
 #include <sstream>
 
@@ -31,6 +34,9 @@
 #include <algorithm>
 #include <cctype>
 
+#include <sys/socket.h> // SOMAXCONN
+#include <unistd.h> // access()
+
 namespace fs = std::filesystem;
 
 struct Location
@@ -43,6 +49,44 @@ struct Location
 	std::string												defaultListingTemplate = "pages/listing-template.html";
 	std::string												index = "index.html";
 	std::map<std::string, bool>								methods = {{"get", true}, {"post", true}, {"delete", true}};
+	size_t													sendfileThreshold = 64 * 1024; // bytes, larger files are sent with sendfile()
+	bool													gzip = false; // compress bodies without a precompressed .gz sibling
+	std::set<std::string>									gzipTypes = {"text/html", "text/css", "text/plain",
+		"application/javascript", "application/json", "application/xml", "image/svg+xml"};
+	size_t													gzipMinLength = 1024; // bytes, smaller bodies are sent as they are
+	size_t													gzipMaxLength = 1024 * 1024; // bytes, larger bodies are sent as they are
+	int														gzipLevel = 6; // 1 fastest to 9 smallest
+};
+
+/* Settings from the [main] part of the config which are not CGI interpreters */
+struct MainConfig
+{
+	std::string												eventLoop = "epoll"; // epoll, poll or io_uring
+	bool													edgeTriggered = false;
+	int														workers = 1; // `auto` is resolved to the number of online CPUs
+	int														threads = 1; // event loop threads per process, `auto` as for workers
+	std::vector<int>										workerCpuAffinity;
+	size_t													fileCacheSize = 32 * 1024 * 1024; // bytes per process, 0 disables the file cache
+	std::string												clientBodyTempPath = "/tmp"; // where bodies past clientBodyBufferSize are spooled
+};
+
+/* Socket tuning of a listener and its clients, 0 or off keeps the kernel default */
+struct SocketOptions
+{
+	int														listenBacklog = SOMAXCONN;
+	bool													tcpNoDelay = false;
+	bool													tcpCork = false; // headers and body leave in full segments
+	int														tcpDeferAccept = 0; // seconds to wait for the first request bytes
+	int														tcpFastOpen = 0; // pending TFO requests queue length
+	int														sendBufferSize = 0; // bytes
+	int														receiveBufferSize = 0; // bytes
+};
+
+/* An error or default page read when the config is loaded, responses share its bytes */
+struct CompiledPage
+{
+	std::shared_ptr<const std::string>						body;
+	std::string												type;
 };
 
 struct ServerConfig
@@ -52,6 +96,15 @@ struct ServerConfig
 	int														port; // = 8080;
 	std::string												serverName; // = "localhost";
 	std::string												clientMaxBodySize = "100M";
+	std::string												clientBodyBufferSize = "1M"; // larger bodies are kept in a temp file
+	int														keepaliveTimeout = 75; // seconds, 0 disables keep-alive
+	int														keepaliveRequests = 100; // requests served per connection
+	int														headerTimeout = 60; // seconds to receive the start line and headers
+	int														bodyTimeout = 60; // seconds between two reads of the body
+	int														bodyMinRate = 0; // bytes per second a body must average, 0 disables
+	int														cgiTimeout = 15; // seconds a script may run
+	int														sendTimeout = 60; // seconds between two writes of the response
+	SocketOptions											socketOptions; // from the first server config of a port
 
 	std::map<int, std::string>								defaultPages = {
 																		{201, "pages/201.html"},
@@ -62,12 +115,16 @@ struct ServerConfig
 																		{405, "pages/405.html"},
 																		{411, "pages/411.html"},
 																		{413, "pages/413.html"},
+																		{414, "pages/414.html"},
+																		{416, "pages/416.html"},
+																		{431, "pages/431.html"},
 																		{500, "pages/500.html"},
 																		{502, "pages/502.html"},
 																		{504, "pages/504.html"},
 																		{505, "pages/505.html"}
 																	};
 	std::map<int, std::string>								errorPages;
+	std::map<int, CompiledPage>								compiledPages; // errorPages over defaultPages, by code
 	std::map<std::string, std::string>*						cgis;
 
 	std::vector<Location>									locations;
@@ -81,6 +138,7 @@ class Config
 		std::map<std::string, std::vector<ServerConfig>>	_serversConfigsMap; // map element example: {"127.0.0.1:8000", serverConfigs}
 		const char*											_argv0;
 		std::map<std::string, std::string>					_cgis;
+		MainConfig											_mainConfig;
 
 		Config() = delete;
 
@@ -88,15 +146,17 @@ class Config
 		void												parseMainConfig(std::string mainConfig);
 		void												parseServers(std::vector<std::string> serverStringsVec);
 		void												parseLocations(ServerConfig& serverConfig, std::vector<std::string> locations);
+		void												compilePages();
 		void 												printConfig();
 		std::vector<std::string>							filterOutInvalidServerStrings(std::vector<std::string> serverStringsVec);
-		fs::path											getExecutablePath();
+		fs::path											getExecutablePath() const;
 		std::string											filterOutComments(std::string configString);
 
 	public:
 		Config(std::string filePath, const char*argv0);
 
-		std::string											normalizeFilePath(std::string rootStr, bool closePath);
-		std::map<std::string, std::vector<ServerConfig>>&	getServersConfigsMap();
-		std::list<std::string>&								getServersConfigsMapKeys();
+		std::string											normalizeFilePath(std::string rootStr, bool closePath) const;
+		const std::map<std::string, std::vector<ServerConfig>>&	getServersConfigsMap() const;
+		const std::list<std::string>&						getServersConfigsMapKeys() const;
+		const MainConfig&									getMainConfig() const;
 };
@@ -6,7 +6,7 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:08:11 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/13 00:18:54 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/03 10:17:52 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -126,8 +126,18 @@ int ConfigValidator::validateMandatoryFields(std::string str, std::vector<std::s
 int ConfigValidator::validateMainConfig(std::string mainConfig)
 {
 	std::regex cgiPattern(R"(\s*[a-z]+\s+(\.\.\/|\/)*([a-zA-Z0-9-_~.]+(\/[a-zA-Z0-9-_~.]+))*\s*)");
+	std::map<std::string, std::regex> patterns = {
+		{"eventLoop", std::regex(R"(\s*eventLoop\s+(poll|epoll|io_uring)\s*)")},
+		{"edgeTriggered", std::regex(R"(\s*edgeTriggered\s+(on|off)\s*)")},
+		{"workers", std::regex(R"(\s*workers\s+([1-9][0-9]{0,2}|auto)\s*)")},
+		{"threads", std::regex(R"(\s*threads\s+([1-9][0-9]{0,2}|auto)\s*)")},
+		{"workerCpuAffinity", std::regex(R"(\s*workerCpuAffinity\s+[0-9]{1,4}(,[0-9]{1,4})*\s*)")},
+		{"fileCacheSize", std::regex(R"(\s*fileCacheSize\s+(off|[0-9]+(G|M|K|B)?)\s*)")},
+		{"clientBodyTempPath", std::regex(R"(\s*clientBodyTempPath\s+\/?([a-zA-Z0-9\-_~.]+\/?)+\s*)")}
+	};
 	int errorsCount = 0;
 	int cgisCount = 0;
+	int directivesCount = 0;
 	int lineCount = 0;
 	mainConfig = Utility::trim(mainConfig);
 	std::istringstream stream(mainConfig);
@@ -151,6 +161,19 @@ int ConfigValidator::validateMainConfig(std::string mainConfig)
 				lineCount++;
 			}
 		}
+		std::string directive = Utility::splitStr(Utility::replaceWhiteSpaces(line, ' '), " ")[0];
+		if (patterns.find(directive) != patterns.end())
+		{
+			if (!std::regex_match(line, patterns[directive]))
+			{
+				errorsCount++;
+				LOG_DEBUG("Line not valid: ", TEXT_RED, line, RESET);
+				continue ;
+			}
+			LOG_DEBUG("Line validated: ", TEXT_GREEN, line, RESET);
+			directivesCount++;
+			continue ;
+		}
 		if (!std::regex_match(line, cgiPattern))
 		{
 			errorsCount++;
@@ -160,7 +183,7 @@ int ConfigValidator::validateMainConfig(std::string mainConfig)
 		LOG_DEBUG("Line validated: ", TEXT_GREEN, line, RESET);
 		cgisCount++;
 	}
-	if (errorsCount != 0 || cgisCount == 0)
+	if (errorsCount != 0 || cgisCount + directivesCount == 0)
 	{
 		LOG_WARNING("Main config is invalid and will be ignored");
 		return errorsCount;
@@ -175,16 +198,35 @@ int ConfigValidator::validateGeneralConfig(std::string generalConfig, std::vecto
 {
 	int generalConfigErrorsCount = 0;
 
-	std::regex linePattern(R"(\s*(ipAddress|port|serverName|clientMaxBodySize|error|cgis|)\s+[a-zA-Z0-9~\-_.,]+\s*[a-zA-Z0-9~\-_.,\/"' ]*\s*)");
+	std::regex linePattern(R"(\s*(ipAddress|port|serverName|clientMaxBodySize|clientBodyBufferSize|keepaliveTimeout|keepaliveRequests|headerTimeout|bodyTimeout|bodyMinRate|cgiTimeout|sendTimeout|listenBacklog|tcpNoDelay|tcpCork|tcpDeferAccept|tcpFastOpen|sendBufferSize|receiveBufferSize|error|cgis|)\s+[a-zA-Z0-9~\-_.,]+\s*[a-zA-Z0-9~\-_.,\/"' ]*\s*)");
 	std::map<std::string, std::regex> patterns = {
 		{"ipAddress", std::regex(R"(\s*ipAddress\s+((25[0-5]|(2[0-4]|1\d|[1-9]|)\d)\.?\b){4}\s*)")},
 		{"port", std::regex(R"(\s*port\s+[0-9]{1,5}\s*)")},
 		{"serverName", std::regex(R"(\s*serverName\s+(([a-zA-Z0-9]|[a-zA-Z0-9][a-zA-Z0-9\-]*[a-zA-Z0-9])\.)*([A-Za-z0-9]|[A-Za-z0-9][A-Za-z0-9\-]*[A-Za-z0-9])\s*)")},
 		{"clientMaxBodySize", std::regex(R"(\s*clientMaxBodySize\s+[1-9]+[0-9]*(G|M|K|B))")},
+		{"clientBodyBufferSize", std::regex(R"(\s*clientBodyBufferSize\s+[0-9]+(G|M|K|B)?\s*)")},
+		{"keepaliveTimeout", std::regex(R"(\s*keepaliveTimeout\s+[0-9]{1,5}\s*)")},
+		{"keepaliveRequests", std::regex(R"(\s*keepaliveRequests\s+[1-9][0-9]{0,5}\s*)")},
+		{"headerTimeout", std::regex(R"(\s*headerTimeout\s+[1-9][0-9]{0,4}\s*)")},
+		{"bodyTimeout", std::regex(R"(\s*bodyTimeout\s+[1-9][0-9]{0,4}\s*)")},
+		{"bodyMinRate", std::regex(R"(\s*bodyMinRate\s+[0-9]{1,9}\s*)")},
+		{"cgiTimeout", std::regex(R"(\s*cgiTimeout\s+[1-9][0-9]{0,4}\s*)")},
+		{"sendTimeout", std::regex(R"(\s*sendTimeout\s+[1-9][0-9]{0,4}\s*)")},
+		{"listenBacklog", std::regex(R"(\s*listenBacklog\s+[1-9][0-9]{0,5}\s*)")},
+		{"tcpNoDelay", std::regex(R"(\s*tcpNoDelay\s+(on|off)\s*)")},
+		{"tcpCork", std::regex(R"(\s*tcpCork\s+(on|off)\s*)")},
+		{"tcpDeferAccept", std::regex(R"(\s*tcpDeferAccept\s+[0-9]{1,4}\s*)")},
+		{"tcpFastOpen", std::regex(R"(\s*tcpFastOpen\s+[0-9]{1,5}\s*)")},
+		{"sendBufferSize", std::regex(R"(\s*sendBufferSize\s+[0-9]{1,9}\s*)")},
+		{"receiveBufferSize", std::regex(R"(\s*receiveBufferSize\s+[0-9]{1,9}\s*)")},
 		{"error", std::regex(R"(\s*error\s+[4-5][0-9]{2}(?:,[4-5][0-9]{2})*\s+((["'])*[^,]+(?:\.html|\.htm)(\2)*)\s*)")}
 	};
 
-	std::vector<std::string> oneAllowed = {"ipAddress", "port", "serverName", "clientMaxBodySize"};
+	std::vector<std::string> oneAllowed = {"ipAddress", "port", "serverName", "clientMaxBodySize",
+											"clientBodyBufferSize", "keepaliveTimeout", "keepaliveRequests", "headerTimeout",
+											"bodyTimeout", "bodyMinRate", "cgiTimeout", "sendTimeout", "listenBacklog",
+											"tcpNoDelay", "tcpCork", "tcpDeferAccept", "tcpFastOpen", "sendBufferSize",
+											"receiveBufferSize"};
 	std::vector<std::string> mandatoryFields = {"port"};
 
 
@@ -251,12 +293,13 @@ int ConfigValidator::validateGeneralConfig(std::string generalConfig, std::vecto
 
 
 /**
- * Validates: path, redirect index, root, methods, uploadPath, autoindex
+ * Validates: path, redirect index, root, methods, uploadPath, autoindex, sendfileThreshold,
+ * gzip, gzipTypes, gzipMinLength, gzipMaxLength, gzipLevel
 */
 int ConfigValidator::validateLocationConfig(std::string locationString)
 {
 	// linePattern is more broad and should have characters from more specific cases
-	std::regex linePattern(R"(\s*(path|redirect|index|root|methods|upload|autoindex)\s+[a-zA-Z0-9~\-_./,:$%"' ]+\s*)");
+	std::regex linePattern(R"(\s*(path|redirect|index|root|methods|upload|autoindex|sendfileThreshold|gzip|gzipTypes|gzipMinLength|gzipMaxLength|gzipLevel)\s+[a-zA-Z0-9~\-_./,:$%"'+ ]+\s*)");
 	std::map<std::string, std::regex> patterns = {
 		{"path", std::regex(R"(\s*path\s+\/([a-zA-Z0-9_\-~.]+\/)*([a-zA-Z0-9_\-~.]+\.[a-zA-Z0-9_\-~.]+)?\s*)")},
 		{"index", std::regex(R"(\s*index\s+([^,\s]+(?:\.html|\.htm))\s*)")},
@@ -267,6 +310,12 @@ int ConfigValidator::validateLocationConfig(std::string locationString)
 		{"upload", std::regex(R"(\s*upload\s+(on|off)\s*)")},
 		{"methods", std::regex(R"(\s*methods\s+(get|post|delete)(,(get|post|delete)){0,2}\s*)")},
 		{"autoindex", std::regex(R"(\s*autoindex\s+(on|off)\s*)")},
+		{"sendfileThreshold", std::regex(R"(\s*sendfileThreshold\s+(off|[0-9]+(G|M|K|B)?)\s*)")},
+		{"gzip", std::regex(R"(\s*gzip\s+(on|off)\s*)")},
+		{"gzipTypes", std::regex(R"(\s*gzipTypes\s+[a-z0-9.+\-]+\/[a-z0-9.+\-]+(,[a-z0-9.+\-]+\/[a-z0-9.+\-]+)*\s*)")},
+		{"gzipMinLength", std::regex(R"(\s*gzipMinLength\s+[0-9]+(G|M|K|B)?\s*)")},
+		{"gzipMaxLength", std::regex(R"(\s*gzipMaxLength\s+[0-9]+(G|M|K|B)?\s*)")},
+		{"gzipLevel", std::regex(R"(\s*gzipLevel\s+[1-9]\s*)")},
 	};
 
 	int locationStringErrorsCount = 0;
@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/02 13:17:21 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/13 10:42:03 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/10/04 11:20:05 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -17,9 +17,8 @@ void CGIHandler::handleCGI(Client& client, Server& server)
 	LOG_INFO(TEXT_GREEN, "Running CGI", RESET);
 	
 	// Save starting time
-	client.setCgiStart(std::chrono::system_clock::now());
-	std::time_t start_time = std::chrono::system_clock::to_time_t(client.getCgiStart());
-	LOG_DEBUG("Cgi started at: ", std::ctime(&start_time));
+	client.setCgiStart(std::chrono::steady_clock::now());
+	LOG_DEBUG("Cgi started at: ", getCurrentTime());
 	
 	LOG_DEBUG("handleCGI function started");
 	std::string interpreter = determineInterpreter(client, client.getRequest()->getStartLine()["path"], server);
@@ -60,7 +59,10 @@ std::string CGIHandler::determineInterpreter(Client& client, const std::string&
 	}
 
 	std::string extension = fileName.substr(fileName.find_last_of(".") + 1);
-	std::string cgiPath = (*(server.findServerConfig(client.getRequest())->cgis))[extension];
+	// The cgi map is shared by all the event loop threads, it is only searched, never filled
+	std::map<std::string, std::string>* cgis = server.findServerConfig(client.getRequest())->cgis;
+	auto cgiIt = cgis->find(extension);
+	std::string cgiPath = cgiIt != cgis->end() ? cgiIt->second : "";
 	
 	if (cgiPath == "")
 	{
@@ -94,47 +96,24 @@ std::vector<std::string> CGIHandler::setEnvironmentVariables(std::shared_ptr<Req
 	return env;
 }
 
-void CGIHandler::handleChildProcess(Client& client, const std::string& interpreter,
-	const std::string& filePath, const std::vector<std::string>& envVars, Server& server)
+/**
+ * Runs in the forked child. Other event loop threads may hold locks (e.g. of
+ * the allocator) at fork time, so the child only calls async-signal-safe
+ * functions. The pipes are close-on-exec, only the duplicated stdin and
+ * stdout stay open in the script
+ */
+void CGIHandler::handleChildProcess(Client& client, int stdinFd, std::vector<char*>& args, std::vector<char*>& envp)
 {
-	LOG_DEBUG("Duplicating stdin and stdout");
-	if (dup2(client.getParentPipe(_in), STDIN_FILENO) < 0 ||
+	if (dup2(stdinFd, STDIN_FILENO) < 0 ||
 		dup2(client.getChildPipe(_out), STDOUT_FILENO) < 0)
-	{
-		closeFds(client);
-		std::exit(EXIT_FAILURE);
-	}
-
-	close(client.getParentPipe(_out));
-	client.setParentPipe(_out, -1);
-	close(client.getChildPipe(_in));
-	client.setChildPipe(_in, -1);
-
-	std::vector<char*> args;
-	args.push_back(const_cast<char*>(interpreter.c_str()));
-	std::string absFilePath = server.getCGIBinFolder() + filePath;
-	args.push_back(const_cast<char*>(absFilePath.c_str()));
-	args.push_back(nullptr);
-	LOG_DEBUG("Agruments set");
+		_exit(EXIT_FAILURE);
 
-	std::vector<char*> envp;
-	for (const auto& var : envVars)
-	{
-		envp.push_back(const_cast<char*>(var.c_str()));
-	}
-	envp.push_back(nullptr);
-	LOG_DEBUG("Environment casted");
-
-	LOG_DEBUG("About to start execve");
-	execve(interpreter.c_str(), args.data(), envp.data());
-	close(client.getParentPipe(_in));
-	client.setParentPipe(_in, -1);
-	close(client.getChildPipe(_out));
-	client.setChildPipe(_out, -1);
-	std::exit(EXIT_FAILURE);
+	execve(args[0], args.data(), envp.data());
+	_exit(EXIT_FAILURE);
 }
 
-void CGIHandler::handleParentProcess(Client& client, const std::string& body)
+/* A spooled body is already the script's stdin, the pipe is closed without writing */
+void CGIHandler::handleParentProcess(Client& client, const RequestBody& body, Server& server)
 {
 	close(client.getParentPipe(_in));
 	client.setParentPipe(_in, -1);
@@ -142,51 +121,55 @@ void CGIHandler::handleParentProcess(Client& client, const std::string& body)
 	client.setChildPipe(_out, -1);
 
 	LOG_DEBUG("Writing body of the request inside the pipe");
-	int bytesRead = write(client.getParentPipe(_out), body.c_str(), body.size());
-	if (bytesRead < 0)
+	if (!body.isSpooled() && !body.copyTo(client.getParentPipe(_out), 0, body.size()))
 	{
 		LOG_DEBUG("Child pid: ", client.getPid());
-		kill(client.getPid(), SIGTERM);
-		removeFromPids(client.getPid());
+		killScript(client);
 		changeToErrorState(client);
 		throw ProcessingError(502, {}, "handleParentProcess() writing failed");
 	}
 
+	unregisterCGIPollFd(server, client.getParentPipe(_out));
 	close(client.getParentPipe(_out));
-	ServersManager::removeFromPollfd(client.getParentPipe(_out));
 	client.setParentPipe(_out, -1);
-	
-	if (bytesRead == 0)
-		LOG_DEBUG("bytesRead: 0");
 	LOG_DEBUG("Wrote body of the request and closed the pipe");
 }
 
 void CGIHandler::handleProcesses(Client& client, const std::string& interpreter,
 	const std::vector<std::string>& envVars, Server& server)
 {
+	// Arguments and environment are built before fork, see handleChildProcess()
+	std::string absFilePath = server.getCGIBinFolder() + client.getRequest()->getStartLine()["path"].substr(9);
+	std::vector<char*> args = {const_cast<char*>(interpreter.c_str()), const_cast<char*>(absFilePath.c_str()), nullptr};
+	std::vector<char*> envp;
+	for (const auto& var : envVars)
+		envp.push_back(const_cast<char*>(var.c_str()));
+	envp.push_back(nullptr);
+	// The script reads a spooled body from the start of its file
+	RequestBody& body = client.getRequest()->getBody();
+	int stdinFd = body.isSpooled() ? body.getFd() : client.getParentPipe(_in);
+	if (body.isSpooled() && lseek(stdinFd, 0, SEEK_SET) == -1)
+	{
+		changeToErrorState(client);
+		throw ProcessingError(502, {}, "Exception (lseek) has been thrown in handleProcesses() "
+			"method of CGIHandler class");
+	}
+
 	pid_t childPid = fork();
-	LOG_DEBUG("forked in handleProcesses");
 	client.setPid(childPid);
 	if (client.getPid() == -1)
 	{
-		kill(client.getPid(), SIGTERM);
-		removeFromPids(client.getPid());
 		changeToErrorState(client);
 		throw ProcessingError(502, {}, "Exception (fork) has been thrown in handleParentProcess() "
 			"method of CGIHandler class");
 	}
 	else if (client.getPid() == 0)
-	{
-		LOG_DEBUG("Child started");
-		handleChildProcess(client, interpreter,
-			client.getRequest()->getStartLine()["path"].erase(0, 9), envVars, server);
-	}
+		handleChildProcess(client, stdinFd, args, envp);
 	else
 	{
 		LOG_DEBUG("Child pid in parent: ", childPid);
 		LOG_DEBUG("Parent started");
-		g_childPids.push_back(client.getPid());
-		handleParentProcess(client, client.getRequest()->getBody());
+		handleParentProcess(client, body, server);
 	}
 	LOG_INFO(TEXT_GREEN, "CGI script executed", RESET);
 }
@@ -245,27 +228,24 @@ void CGIHandler::setToInit(Client& client)
 	client.setParentPipe(_out, -1);
 }
 
-void CGIHandler::registerCGIPollFd(int fd, short events, std::vector<pollfd>& new_fds)
+void CGIHandler::registerCGIPollFd(Server& server, Client& client, int fd, short events, FdTable::FdRole role)
 {
 	LOG_DEBUG("CGIHandler::registerCGIPollFd() called");
-	new_fds.push_back({fd, events, 0});
+	server.watchFd(fd, events, role, client.getHandle());
 }
 
 void CGIHandler::unregisterCGIPollFd(Server& server, int fd)
 {
-	server.getFds()->erase(std::remove_if(server.getFds()->begin(),
-		server.getFds()->end(), [fd](const pollfd& pfd)
-	{
-		return pfd.fd == fd;
-	}), server.getFds()->end());
+	server.unwatchFd(fd);
 }
 
-void CGIHandler::InitCGI(Client& client, std::vector<pollfd>& new_fds)
+void CGIHandler::InitCGI(Client& client, Server& server)
 {
 	LOG_DEBUG("Initializing CGI");
 	std::shared_ptr<Response> response = std::make_shared<Response>();
 	client.setResponse(response);
-	if (pipe(client.getParentPipeWhole()) == -1 || pipe(client.getChildPipeWhole()) == -1)
+	// Close-on-exec keeps the pipes out of scripts forked by other event loop threads
+	if (pipe2(client.getParentPipeWhole(), O_CLOEXEC) == -1 || pipe2(client.getChildPipeWhole(), O_CLOEXEC) == -1)
 	{
 		changeToErrorState(client);
 		throw ProcessingError(502, {}, "Exception (pipe) has been thrown in InitCGI() "
@@ -275,37 +255,37 @@ void CGIHandler::InitCGI(Client& client, std::vector<pollfd>& new_fds)
 	LOG_DEBUG("Pipes numbers: ",client.getParentPipe(_in)," ",client.getParentPipe(_out),
 		" ", client.getChildPipe(_in)," ",client.getChildPipe(_out));
 	
-	registerCGIPollFd(client.getChildPipe(_in), POLLIN, new_fds);
-	registerCGIPollFd(client.getParentPipe(_out), POLLOUT, new_fds);
+	registerCGIPollFd(server, client, client.getChildPipe(_in), POLLIN, FdTable::FdRole::CGI_STDOUT);
+	registerCGIPollFd(server, client, client.getParentPipe(_out), POLLOUT, FdTable::FdRole::CGI_STDIN);
 	LOG_DEBUG("Finished InitCGI()");
 }
 
-bool CGIHandler::readScriptOutput(Client& client, std::shared_ptr<Server>& server)
+bool CGIHandler::readScriptOutput(Client& client, Server& server)
 {
 	LOG_DEBUG("readScriptOutput() called");
 	
 	char buffer[g_bufferSize];
 	ssize_t bytesRead;
-	ssize_t currPipeSize = 0;
 	
 	std::fill(buffer, buffer + g_bufferSize, 0);
-	while ((bytesRead = read(client.getChildPipe(_in), buffer, sizeof(buffer))) > 0)
+	while ((bytesRead = server.getEventLoop()->receive(client.getChildPipe(_in), buffer, sizeof(buffer))) > 0)
 	{
-		currPipeSize += bytesRead;
-		if (currPipeSize >= _pipeMaxSize)
+		// Counted over the whole output, a completion backend hands it over in several calls
+		if (client.getRespBody().size() + bytesRead >= _pipeMaxSize)
 		{
-			kill(client.getPid(), SIGTERM);
-			removeFromPids(client.getPid());
+			killScript(client);
 			throw ProcessingError(502, {}, "Pipe overflowed");
 		}
 		LOG_DEBUG(TEXT_GREEN, "Populating response body with: ", bytesRead, RESET);
 		LOG_DEBUG(TEXT_GREEN, "Response body: ", buffer, RESET);
 		client.getRespBody().append(buffer, bytesRead);
 	}
+	// Only a completion backend answers EAGAIN, the pipe itself is blocking
+	if (bytesRead < 0 && errno == EAGAIN)
+		return false;
 	if (bytesRead < 0)
 	{
-		kill(client.getPid(), SIGTERM);
-		removeFromPids(client.getPid());
+		killScript(client);
 		throw ProcessingError(502, {}, "readScriptOutput() reading failed");
 	}
 	if (bytesRead != 0)
@@ -318,13 +298,13 @@ bool CGIHandler::readScriptOutput(Client& client, std::shared_ptr<Server>& serve
 	
 	checkResponseHeaders(client.getRespBody(), client.getResponse());
 	
+	unregisterCGIPollFd(server, client.getChildPipe(_in));
 	close(client.getChildPipe(_in));
-	unregisterCGIPollFd(*server, client.getChildPipe(_in));
 	client.setChildPipe(_in, -1);
 	
-	auto it = std::find(g_childPids.begin(), g_childPids.end(), client.getPid());
-	if (it != g_childPids.end())
-		g_childPids.erase(it);
+	// The script closed its stdout, it is reaped here if it has already exited
+	waitpid(client.getPid(), nullptr, WNOHANG);
+	server.compressCGIResponse(client);
 	return true;
 }
 
@@ -334,15 +314,12 @@ void CGIHandler::changeToErrorState(Client& client)
 	client.setCGIState(Client::CGIState::FINISHED_SET);
 }
 
-void CGIHandler::removeFromPids(pid_t pid)
+/* Stops a running script, the process is reaped right away if it has already exited */
+void CGIHandler::killScript(Client& client)
 {
-	// remove from g_childPids vector
-	for (auto it = g_childPids.begin(); it != g_childPids.end(); ++it)
-	{
-		if (*it == pid)
-		{
-			g_childPids.erase(it);
-			break;
-		}
-	}
+	if (client.getPid() <= 0)
+		return ;
+	kill(client.getPid(), SIGTERM);
+	waitpid(client.getPid(), nullptr, WNOHANG);
+	client.setPid(-1);
 }
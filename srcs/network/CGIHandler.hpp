@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/02 15:53:37 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/09 13:46:50 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -15,12 +15,14 @@
 #include "../request/Request.hpp"
 #include "Server.hpp"
 #include "Client.hpp"
+#include "FdTable.hpp"
 #include "../response/Response.hpp"
 #include "../utils/logUtils.hpp"
 #include "../utils/globals.hpp"
 
 #include <poll.h>
 #include <unistd.h>
+#include <fcntl.h> // O_CLOEXEC
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -45,20 +47,21 @@ class CGIHandler {
 		static std::vector<std::string>		setEnvironmentVariables(std::shared_ptr<Request> request);
 		static void							handleProcesses(Client& client, const std::string& interpreter,
 												const std::vector<std::string>& envVars, Server& server);
-		static void							handleChildProcess(Client& client, const std::string& interpreter,
-												const std::string& filePath, const std::vector<std::string>& envVars, Server& server);
-		static void							handleParentProcess(Client& client, const std::string& body);
+		[[noreturn]] static void			handleChildProcess(Client& client, int stdinFd, std::vector<char*>& args,
+												std::vector<char*>& envp);
+		static void							handleParentProcess(Client& client, const RequestBody& body, Server& server);
 		static void							checkResponseHeaders(const std::string& result, std::shared_ptr<Response> response);
-		static void							registerCGIPollFd(int fd, short events, std::vector<pollfd>& new_fds);
+		static void							registerCGIPollFd(Server& server, Client& client, int fd, short events,
+												FdTable::FdRole role);
 		static void							unregisterCGIPollFd(Server& server, int fd);
 
 	public:
 		CGIHandler()						= delete;
 		static void							changeToErrorState(Client& client);
 		static void							handleCGI(Client& client, Server& server);
-		static void							InitCGI(Client& client, std::vector<pollfd>& new_fds);
-		static bool							readScriptOutput(Client& client, std::shared_ptr<Server>& server);
+		static void							InitCGI(Client& client, Server& server);
+		static bool							readScriptOutput(Client& client, Server& server);
 		static void							closeFds(Client& client);
 		static void							setToInit(Client& client);
-		static void							removeFromPids(pid_t pid);
+		static void							killScript(Client& client);
 };
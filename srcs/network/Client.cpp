@@ -6,39 +6,157 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/19 12:29:37 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/05 13:24:54 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/04 14:12:37 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "Client.hpp"
 
 Client::Client() :
-		_fd(-1),
+		_hot(&_ownHot),
 		_pid(-1),
 		_parentPipe{-1, -1},
 		_childPipe{-1, -1},
 		_request(nullptr),
 		_response(nullptr),
-		_state(ClientState::READING),
-		_stateCGI(CGIState::INIT),
+		_pipelinedOffset(0),
+		_pipelinedTaken(0),
 		_emptyLinePos(-1),
 		_emptyLinesSize(0),
 		_contentLengthNum(std::string::npos),
 		_isHeadersRead(false),
 		_isBodyRead(false),
 		_maxClientBodyBytes(std::numeric_limits<size_t>::max()),
-		_totalBytesWritten(0),
-		_cgiStart(std::chrono::system_clock::now()) {}
+		_cgiStart(std::chrono::steady_clock::now()),
+		_keepAlive(false),
+		_requestsServed(0) {}
+
+/* A pooled client, its hot fields live in the pool slot */
+Client::Client(Hot* hot, ClientHandle handle) : Client()
+{
+	*hot = Hot();
+	_hot = hot;
+	_handle = handle;
+}
 
 Client::~Client() {}
 
+/**
+ * Brings a kept-alive connection back to READING. The fd, the bytes of a
+ * pipelined request and the connection counters are kept, CGI pipes are
+ * closed by the server before this is called
+ */
+void Client::resetForNextRequest()
+{
+	_pid = -1;
+	_CGIString.clear();
+	_request = nullptr;
+	_response = nullptr;
+	_respBody.clear();
+	_hot->state = ClientState::READING;
+	_hot->stateCGI = CGIState::INIT;
+	_requestString.clear();
+	_parser.reset();
+	_requestBody.clear();
+	_emptyLinePos = -1;
+	_emptyLinesSize = 0;
+	_contentLengthNum = std::string::npos;
+	_isHeadersRead = false;
+	_isBodyRead = false;
+	_maxClientBodyBytes = std::numeric_limits<size_t>::max();
+	_output.clear();
+	_hot->totalBytesWritten = 0;
+	_hot->wouldBlock = false;
+	_keepAlive = false;
+	_requestsServed++;
+	_hot->lastActivity = std::chrono::steady_clock::now();
+	if (_pendingRequest)
+	{
+		_requestString = std::move(_pendingRequest->requestString);
+		_parser = _pendingRequest->parser;
+		_requestBody = std::move(_pendingRequest->requestBody);
+		_emptyLinePos = _pendingRequest->emptyLinePos;
+		_emptyLinesSize = _pendingRequest->emptyLinesSize;
+		_contentLengthNum = _pendingRequest->contentLengthNum;
+		_isHeadersRead = _pendingRequest->isHeadersRead;
+		_maxClientBodyBytes = _pendingRequest->maxClientBodyBytes;
+		_pendingRequest.reset();
+	}
+}
+
+/**
+ * Up to length of the kept bytes go to the end of the request. The slices grow,
+ * so a deep pipeline is not copied once per request
+ */
+void Client::takePipelinedBytes(size_t length)
+{
+	length = std::min(length, _pipelinedString.size() - _pipelinedOffset);
+	_requestString.append(_pipelinedString, _pipelinedOffset, length);
+	_pipelinedOffset += length;
+	_pipelinedTaken = length;
+}
+
+/**
+ * Bytes after requestEnd belong to the next request. Taken from the kept bytes
+ * they are given back by moving the offset, read from the socket they are kept
+ */
+void Client::keepPipelinedBytes(size_t requestEnd)
+{
+	size_t	extra = _requestString.size() - requestEnd;
+
+	if (extra <= _pipelinedTaken)
+		_pipelinedOffset -= extra;
+	else
+	{
+		_pipelinedString.assign(_requestString, requestEnd, extra);
+		_pipelinedOffset = 0;
+	}
+	_pipelinedTaken = 0;
+	_requestString.resize(requestEnd);
+}
+
+/* The kept bytes change hands without a copy, e.g. for a request parsed ahead in a batch */
+void Client::movePipelinedBytesTo(Client& other)
+{
+	other._pipelinedString = std::move(_pipelinedString);
+	other._pipelinedOffset = _pipelinedOffset;
+	other._pipelinedTaken = 0;
+	_pipelinedString.clear();
+	_pipelinedOffset = 0;
+	_pipelinedTaken = 0;
+}
+
+/* The unfinished request of other is taken over by the next resetForNextRequest(), so it is not parsed again */
+void Client::keepPendingRequest(Client& other)
+{
+	_pendingRequest = std::make_unique<PendingRequest>();
+	_pendingRequest->requestString = std::move(other._requestString);
+	_pendingRequest->parser = other._parser;
+	_pendingRequest->requestBody = std::move(other._requestBody);
+	_pendingRequest->emptyLinePos = other._emptyLinePos;
+	_pendingRequest->emptyLinesSize = other._emptyLinesSize;
+	_pendingRequest->contentLengthNum = other._contentLengthNum;
+	_pendingRequest->isHeadersRead = other._isHeadersRead;
+	_pendingRequest->maxClientBodyBytes = other._maxClientBodyBytes;
+}
+
+bool Client::hasPipelinedBytes()
+{
+	return _pipelinedOffset < _pipelinedString.size();
+}
+
 /**
  * Getters
  */
 
 int Client::getFd()
 {
-	return _fd;
+	return _hot->fd;
+}
+
+ClientHandle Client::getHandle()
+{
+	return _handle;
 }
 
 pid_t Client::getPid()
@@ -92,19 +210,29 @@ std::shared_ptr<Response> Client::getResponse()
 
 Client::ClientState Client::getState()
 {
-	return _state;
+	return _hot->state;
 }
 
 Client::CGIState Client::getCGIState()
 {
-	return _stateCGI;
+	return _hot->stateCGI;
 }
 
-std::string Client::getRequestString()
+std::string& Client::getRequestString()
 {
 	return _requestString;
 }
 
+RequestParser& Client::getParser()
+{
+	return _parser;
+}
+
+RequestBody& Client::getRequestBody()
+{
+	return _requestBody;
+}
+
 bool Client::getIsHeadersRead()
 {
 	return _isHeadersRead;
@@ -134,28 +262,78 @@ size_t Client::getMaxClientBodyBytes()
 	return _maxClientBodyBytes;
 }
 
-std::string Client::getResponseString()
+OutputChain& Client::getOutput()
 {
-	return _responseString;
+	return _output;
 }
 
 size_t Client::getTotalBytesWritten()
 {
-	return _totalBytesWritten;
+	return _hot->totalBytesWritten;
 }
 
-std::chrono::system_clock::time_point Client::getCgiStart()
+std::chrono::steady_clock::time_point Client::getCgiStart()
 {
 	return _cgiStart;
 }
 
+bool Client::getWouldBlock()
+{
+	return _hot->wouldBlock;
+}
+
+size_t Client::getPipelinedOffset()
+{
+	return _pipelinedOffset;
+}
+
+bool Client::getKeepAlive()
+{
+	return _keepAlive;
+}
+
+size_t Client::getRequestsServed()
+{
+	return _requestsServed;
+}
+
+int Client::getKeepAliveTimeout()
+{
+	return _hot->keepAliveTimeout;
+}
+
+std::chrono::steady_clock::time_point Client::getLastActivity()
+{
+	return _hot->lastActivity;
+}
+
+Client::Phase Client::getPhase()
+{
+	return _hot->phase;
+}
+
+std::chrono::steady_clock::time_point Client::getPhaseStart()
+{
+	return _hot->phaseStart;
+}
+
+std::chrono::steady_clock::time_point Client::getDeadline()
+{
+	return _hot->deadline;
+}
+
+std::chrono::steady_clock::time_point Client::getTimerAt()
+{
+	return _hot->timerAt;
+}
+
 /**
  * Setters
  */
 
 void Client::setFd(int fd)
 {
-	_fd = fd;
+	_hot->fd = fd;
 }
 
 void Client::setPid(pid_t pid)
@@ -196,17 +374,19 @@ void Client::setResponse(std::shared_ptr<Response> response)
 
 void Client::setState(ClientState state)
 {
-	_state = state;
+	_hot->state = state;
 }
 
 void Client::setCGIState(CGIState stateCGI)
 {
-	_stateCGI = stateCGI;
+	_hot->stateCGI = stateCGI;
 }
 
-void Client::setRequestString(const std::string& requestString)
+/* Bytes of a read go to the end of the buffer, what arrived before is not copied again */
+void Client::appendRequestString(const char* data, size_t length)
 {
-	_requestString = requestString;
+	_requestString.append(data, length);
+	_pipelinedTaken = 0;
 }
 
 void Client::setIsHeadersRead(bool isHeadersRead)
@@ -239,17 +419,62 @@ void Client::setMaxClientBodyBytes(size_t maxClientBodyBytes)
 	_maxClientBodyBytes = maxClientBodyBytes;
 }
 
-void Client::setResponseString(const std::string& responseString)
+void Client::setTotalBytesWritten(size_t totalBytesWritten)
+{
+	_hot->totalBytesWritten = totalBytesWritten;
+}
+
+void Client::setCgiStart(std::chrono::steady_clock::time_point cgiStart)
 {
-	_responseString = responseString;
+	_cgiStart = cgiStart;
 }
 
-void Client::setTotalBytesWritten(size_t totalBytesWritten)
+void Client::setWouldBlock(bool wouldBlock)
 {
-	_totalBytesWritten = totalBytesWritten;
+	_hot->wouldBlock = wouldBlock;
 }
 
-void Client::setCgiStart(std::chrono::system_clock::time_point cgiStart)
+void Client::setPipelinedOffset(size_t pipelinedOffset)
 {
-	_cgiStart = cgiStart;
+	_pipelinedOffset = pipelinedOffset;
+}
+
+void Client::setKeepAlive(bool keepAlive)
+{
+	_keepAlive = keepAlive;
+}
+
+void Client::setRequestsServed(size_t requestsServed)
+{
+	_requestsServed = requestsServed;
+}
+
+void Client::setKeepAliveTimeout(int keepAliveTimeout)
+{
+	_hot->keepAliveTimeout = keepAliveTimeout;
+}
+
+void Client::setLastActivity(std::chrono::steady_clock::time_point lastActivity)
+{
+	_hot->lastActivity = lastActivity;
+}
+
+void Client::setPhase(Phase phase)
+{
+	_hot->phase = phase;
+}
+
+void Client::setPhaseStart(std::chrono::steady_clock::time_point phaseStart)
+{
+	_hot->phaseStart = phaseStart;
+}
+
+void Client::setDeadline(std::chrono::steady_clock::time_point deadline)
+{
+	_hot->deadline = deadline;
+}
+
+void Client::setTimerAt(std::chrono::steady_clock::time_point timerAt)
+{
+	_hot->timerAt = timerAt;
 }
@@ -6,16 +6,20 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/19 12:27:08 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/05 13:16:54 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/04 14:12:37 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #pragma once
 
 #include "../request/Request.hpp"
+#include "../request/RequestParser.hpp"
 #include "../response/Response.hpp"
+#include "../response/OutputChain.hpp"
 #include <limits>
+#include <memory>
 #include <string>
+#include <cstdint>
 
 #include <chrono>
 
@@ -24,6 +28,13 @@ class Request;
 // Forward declaration of the Response class
 class Response;
 
+/* Slot of a pooled client, the generation tells a reused slot from the client which held it before */
+struct ClientHandle
+{
+	uint32_t	slot = std::numeric_limits<uint32_t>::max();
+	uint32_t	generation = 0;
+};
+
 class Client
 {
 	public:
@@ -43,9 +54,54 @@ class Client
 			FINISHED_SET,
 			FINISHED
 		};
+
+		/* Part of the connection life a deadline is counted for */
+		enum class Phase
+		{
+			NONE,
+			IDLE,
+			HEADERS,
+			BODY,
+			CGI,
+			WRITE
+		};
+
+		/**
+		 * Fields read on every tick and by the timeout sweeps. Pooled clients
+		 * keep them in the pool's hot array, apart from the buffers below
+		 */
+		struct Hot
+		{
+			int										fd = -1;
+			ClientState								state = ClientState::READING;
+			CGIState								stateCGI = CGIState::INIT;
+			bool									wouldBlock = false;
+			int										keepAliveTimeout = 0;
+			size_t									totalBytesWritten = 0;
+			std::chrono::steady_clock::time_point	lastActivity = std::chrono::steady_clock::now();
+			Phase									phase = Phase::NONE;
+			std::chrono::steady_clock::time_point	phaseStart = std::chrono::steady_clock::now();
+			std::chrono::steady_clock::time_point	deadline = std::chrono::steady_clock::time_point::max();
+			std::chrono::steady_clock::time_point	timerAt = std::chrono::steady_clock::time_point::max(); // earliest timer in the wheel
+		};
 	
 	private:
-		int											_fd;
+		/* A request parsed ahead in a pipelined batch which did not arrive whole, taken over after the batch */
+		struct PendingRequest
+		{
+			std::string								requestString;
+			RequestParser							parser;
+			RequestBody								requestBody;
+			int										emptyLinePos = -1;
+			int										emptyLinesSize = 0;
+			size_t									contentLengthNum = std::string::npos;
+			bool									isHeadersRead = false;
+			size_t									maxClientBodyBytes = std::numeric_limits<size_t>::max();
+		};
+
+		Hot											_ownHot; // used when the client is not pooled
+		Hot*										_hot;
+		ClientHandle								_handle;
 		pid_t										_pid;
 		int											_parentPipe[2];
 		int											_childPipe[2];
@@ -53,10 +109,14 @@ class Client
 		std::shared_ptr<Request>					_request;
 		std::shared_ptr<Response>					_response;
 		std::string									_respBody;
-		ClientState									_state;
-		CGIState									_stateCGI;
 
 		std::string									_requestString;
+		std::string									_pipelinedString; // bytes of the next requests on the connection
+		size_t										_pipelinedOffset; // start of the bytes not taken yet
+		size_t										_pipelinedTaken; // length of the last slice taken into _requestString
+		std::unique_ptr<PendingRequest>				_pendingRequest;
+		RequestParser								_parser; // where the request in _requestString ends
+		RequestBody									_requestBody; // decoded body, moved out of _requestString as it arrives
 		int											_emptyLinePos;
 		int											_emptyLinesSize;
 		size_t										_contentLengthNum;
@@ -64,15 +124,29 @@ class Client
 		bool										_isBodyRead;
 		size_t										_maxClientBodyBytes;
 
-		std::string									_responseString;
-		size_t										_totalBytesWritten;
-		std::chrono::system_clock::time_point		_cgiStart;
+		OutputChain									_output; // serialized responses not yet written
+		std::chrono::steady_clock::time_point		_cgiStart;
+
+		bool										_keepAlive;
+		size_t										_requestsServed;
 
 	public:
 		Client();
+		Client(Hot* hot, ClientHandle handle);
 		~Client();
 
+		Client(const Client&) = delete;
+		Client& operator=(const Client&) = delete;
+
+		void										resetForNextRequest();
+		void										takePipelinedBytes(size_t length);
+		void										keepPipelinedBytes(size_t requestEnd);
+		void										movePipelinedBytesTo(Client& other);
+		void										keepPendingRequest(Client& other);
+		bool										hasPipelinedBytes();
+
 		int											getFd();
+		ClientHandle								getHandle();
 		pid_t										getPid();
 		int											getChildPipe(int index);
 		int*										getChildPipeWhole();
@@ -84,16 +158,28 @@ class Client
 		std::shared_ptr<Response>					getResponse();
 		ClientState									getState();
 		CGIState									getCGIState();
-		std::string									getRequestString();
+		std::string&								getRequestString();
+		RequestParser&								getParser();
+		RequestBody&								getRequestBody();
 		bool										getIsHeadersRead();
 		bool										getIsBodyRead();
 		int											getEmptyLinePos();
 		int											getEmptyLinesSize();
 		size_t										getContentLengthNum();
 		size_t										getMaxClientBodyBytes();
-		std::string									getResponseString();
+		OutputChain&								getOutput();
 		size_t										getTotalBytesWritten();
-		std::chrono::system_clock::time_point		getCgiStart();
+		std::chrono::steady_clock::time_point		getCgiStart();
+		bool										getWouldBlock();
+		size_t										getPipelinedOffset();
+		bool										getKeepAlive();
+		size_t										getRequestsServed();
+		int											getKeepAliveTimeout();
+		std::chrono::steady_clock::time_point		getLastActivity();
+		Phase										getPhase();
+		std::chrono::steady_clock::time_point		getPhaseStart();
+		std::chrono::steady_clock::time_point		getDeadline();
+		std::chrono::steady_clock::time_point		getTimerAt();
 		
 		void										setFd(int fd);
 		void										setPid(pid_t pid);
@@ -104,14 +190,23 @@ class Client
 		void										setResponse(std::shared_ptr<Response> response);
 		void										setState(ClientState state);
 		void										setCGIState(CGIState state);
-		void										setRequestString(const std::string& requestString);
+		void										appendRequestString(const char* data, size_t length);
 		void										setEmptyLinePos(int emptyLinePos);
 		void										setEmptyLinesSize(int emptyLinesSize);
 		void										setContentLengthNum(size_t contentLengthNum);
 		void										setIsHeadersRead(bool isHeadersRead);
 		void										setIsBodyRead(bool isBodyRead);
 		void										setMaxClientBodyBytes(size_t maxClientBodyBytes);
-		void										setResponseString(const std::string& responseString);
 		void										setTotalBytesWritten(size_t totalBytesWritten);
-		void										setCgiStart(std::chrono::system_clock::time_point cgiStart);
+		void										setCgiStart(std::chrono::steady_clock::time_point cgiStart);
+		void										setWouldBlock(bool wouldBlock);
+		void										setPipelinedOffset(size_t pipelinedOffset);
+		void										setKeepAlive(bool keepAlive);
+		void										setRequestsServed(size_t requestsServed);
+		void										setKeepAliveTimeout(int keepAliveTimeout);
+		void										setLastActivity(std::chrono::steady_clock::time_point lastActivity);
+		void										setPhase(Phase phase);
+		void										setPhaseStart(std::chrono::steady_clock::time_point phaseStart);
+		void										setDeadline(std::chrono::steady_clock::time_point deadline);
+		void										setTimerAt(std::chrono::steady_clock::time_point timerAt);
 };
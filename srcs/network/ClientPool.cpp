@@ -0,0 +1,79 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ClientPool.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/26 11:32:18 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/26 11:32:18 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#include "ClientPool.hpp"
+
+/* Takes the most recently freed slot, its chunk is likely still in cache */
+Client& ClientPool::acquire()
+{
+	if (_freeSlots.empty())
+	{
+		size_t firstSlot = capacity();
+		_chunks.push_back(std::make_unique<Chunk>());
+		for (size_t slot = firstSlot + _chunkSize; slot-- > firstSlot;)
+			_freeSlots.push_back(static_cast<uint32_t>(slot));
+	}
+	uint32_t slot = _freeSlots.back();
+	_freeSlots.pop_back();
+
+	Chunk& chunk = *_chunks[slot / _chunkSize];
+	size_t index = slot % _chunkSize;
+	_size++;
+	return chunk.clients[index].emplace(&chunk.hot[index], ClientHandle{slot, chunk.generations[index]});
+}
+
+/* Bumping the generation invalidates the handles still held for the slot */
+void ClientPool::release(ClientHandle handle)
+{
+	if (!get(handle))
+		return ;
+	Chunk& chunk = *_chunks[handle.slot / _chunkSize];
+	size_t index = handle.slot % _chunkSize;
+	chunk.clients[index].reset();
+	chunk.hot[index].fd = -1;
+	chunk.generations[index]++;
+	_freeSlots.push_back(handle.slot);
+	_size--;
+}
+
+Client* ClientPool::get(ClientHandle handle)
+{
+	if (handle.slot >= capacity())
+		return nullptr;
+	Chunk& chunk = *_chunks[handle.slot / _chunkSize];
+	size_t index = handle.slot % _chunkSize;
+	if (!chunk.clients[index] || chunk.generations[index] != handle.generation)
+		return nullptr;
+	return &*chunk.clients[index];
+}
+
+/* Returns nullptr for a free slot */
+Client* ClientPool::at(size_t slot)
+{
+	std::optional<Client>& client = _chunks[slot / _chunkSize]->clients[slot % _chunkSize];
+	return client ? &*client : nullptr;
+}
+
+/* The fd of a free slot is -1 */
+const Client::Hot& ClientPool::hotAt(size_t slot) const
+{
+	return _chunks[slot / _chunkSize]->hot[slot % _chunkSize];
+}
+
+size_t ClientPool::capacity() const
+{
+	return _chunks.size() * _chunkSize;
+}
+
+size_t ClientPool::size() const
+{
+	return _size;
+}
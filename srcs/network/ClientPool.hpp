@@ -0,0 +1,52 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ClientPool.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/26 11:32:18 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/26 11:32:18 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#pragma once
+
+#include "Client.hpp"
+#include <array>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/**
+ * Connection table of a server. Clients live in fixed-size chunks which are
+ * never moved, so a Client& stays valid until the client is released, and a
+ * released slot is reused by the next connection. Each chunk keeps the hot
+ * fields of its clients in one contiguous array, the sweeps scan it without
+ * loading the request and response buffers. Fds and events refer to clients
+ * by handles, a handle of a released client resolves to nullptr
+ */
+class ClientPool
+{
+	private:
+		static constexpr size_t						_chunkSize = 256;
+
+		struct Chunk
+		{
+			std::array<Client::Hot, _chunkSize>				hot;
+			std::array<uint32_t, _chunkSize>				generations = {};
+			std::array<std::optional<Client>, _chunkSize>	clients;
+		};
+
+		std::vector<std::unique_ptr<Chunk>>			_chunks;
+		std::vector<uint32_t>						_freeSlots;
+		size_t										_size = 0;
+
+	public:
+		Client&										acquire();
+		void										release(ClientHandle handle);
+		Client*										get(ClientHandle handle);
+		Client*										at(size_t slot);
+		const Client::Hot&							hotAt(size_t slot) const;
+		size_t										capacity() const;
+		size_t										size() const;
+};
@@ -0,0 +1,121 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EpollLoop.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/14 12:10:41 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/14 12:10:41 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "EpollLoop.hpp"
+
+EpollLoop::EpollLoop(bool edgeTriggered) : EventLoop(edgeTriggered), _events(_initialEventsSize)
+{
+	LOG_DEBUG("EpollLoop constructor called");
+
+	_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epollFd < 0)
+		throw ServerException("epoll_create1() error: " + std::string(strerror(errno)));
+}
+
+EpollLoop::~EpollLoop()
+{
+	LOG_DEBUG("EpollLoop destructor called");
+
+	if (_epollFd >= 0)
+		close(_epollFd);
+}
+
+uint32_t EpollLoop::toEpollEvents(short events) const
+{
+	uint32_t epollEvents = 0;
+
+	if (events & POLLIN)
+		epollEvents |= EPOLLIN;
+	if (events & POLLOUT)
+		epollEvents |= EPOLLOUT;
+	if (_edgeTriggered)
+		epollEvents |= EPOLLET;
+	return epollEvents;
+}
+
+short EpollLoop::toPollEvents(uint32_t events) const
+{
+	short pollEvents = 0;
+
+	if (events & EPOLLIN)
+		pollEvents |= POLLIN;
+	if (events & EPOLLOUT)
+		pollEvents |= POLLOUT;
+	if (events & EPOLLERR)
+		pollEvents |= POLLERR;
+	if (events & (EPOLLHUP | EPOLLRDHUP))
+		pollEvents |= POLLHUP;
+	return pollEvents;
+}
+
+void EpollLoop::control(int operation, int fd, short events)
+{
+	struct epoll_event event = {};
+
+	event.events = toEpollEvents(events);
+	event.data.fd = fd;
+	if (epoll_ctl(_epollFd, operation, fd, &event) < 0)
+		throw ServerException("epoll_ctl() error: " + std::string(strerror(errno)));
+}
+
+void EpollLoop::add(int fd, short events)
+{
+	try
+	{
+		control(EPOLL_CTL_ADD, fd, events);
+	}
+	catch (const ServerException& e)
+	{
+		if (e.getErrno() != EEXIST)
+			throw ;
+		control(EPOLL_CTL_MOD, fd, events);
+	}
+}
+
+void EpollLoop::modify(int fd, short events)
+{
+	control(EPOLL_CTL_MOD, fd, events);
+}
+
+/* ENOENT/EBADF mean the fd is not in the set anymore, so the result is not checked */
+void EpollLoop::remove(int fd)
+{
+	epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	dropReadyEvents(fd);
+}
+
+std::vector<struct pollfd>& EpollLoop::wait(int timeoutMs)
+{
+	_ready.clear();
+	if (!_rearmed.empty())
+		timeoutMs = 0;
+
+	int ready = epoll_wait(_epollFd, _events.data(), _events.size(), timeoutMs);
+	if (ready == -1)
+	{
+		if (errno != EINTR)
+			throw ServerException("epoll_wait() error: " + std::string(strerror(errno)));
+		ready = 0;
+	}
+	for (int i = 0; i < ready; i++)
+		_ready.push_back({_events[i].data.fd, 0, toPollEvents(_events[i].events)});
+	// More fds might have been ready than fitted in the buffer, let it grow for the next tick
+	if (static_cast<size_t>(ready) == _events.size())
+		_events.resize(_events.size() * 2);
+	mergeRearmedEvents();
+	return _ready;
+}
+
+std::string EpollLoop::getName() const
+{
+	return "epoll";
+}
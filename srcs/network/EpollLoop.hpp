@@ -0,0 +1,50 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EpollLoop.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/14 12:10:41 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/14 12:10:41 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "EventLoop.hpp"
+#include <sys/epoll.h>
+#include <unistd.h> // close()
+#include <errno.h>
+#include <cstring> // strerror()
+
+/**
+ * epoll backend. Level-triggered by default, edge-triggered when
+ * edgeTriggered is set in the main config. In edge-triggered mode handlers
+ * have to read/write until EAGAIN or rearm() the fd.
+ *
+ * An fd has to be removed before it is closed: a CGI child may still hold
+ * a copy of it, and then the kernel keeps it in the epoll set.
+ */
+class EpollLoop : public EventLoop
+{
+	private:
+		static const int					_initialEventsSize = 64;
+
+		int									_epollFd;
+		std::vector<struct epoll_event>		_events;
+
+		uint32_t							toEpollEvents(short events) const;
+		short								toPollEvents(uint32_t events) const;
+		void								control(int operation, int fd, short events);
+
+	public:
+		EpollLoop(bool edgeTriggered);
+		~EpollLoop();
+
+		void								add(int fd, short events) override;
+		void								modify(int fd, short events) override;
+		void								remove(int fd) override;
+		std::vector<struct pollfd>&			wait(int timeoutMs) override;
+		std::string							getName() const override;
+};
@@ -0,0 +1,154 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EventLoop.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/14 12:10:41 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/04 09:48:23 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "EventLoop.hpp"
+#include "PollLoop.hpp"
+#include "EpollLoop.hpp"
+#ifdef WEBSERV_URING
+# include "UringLoop.hpp"
+#endif
+
+EventLoop::EventLoop(bool edgeTriggered) : _edgeTriggered(edgeTriggered) {}
+
+/* Clears events of the fd which are still waiting to be handled in the current tick */
+void EventLoop::dropReadyEvents(int fd)
+{
+	for (struct pollfd& pfd : _ready)
+	{
+		if (pfd.fd == fd)
+			pfd.revents = 0;
+	}
+	_rearmed.erase(std::remove_if(_rearmed.begin(), _rearmed.end(), [fd](const pollfd& pfd)
+	{
+		return pfd.fd == fd;
+	}), _rearmed.end());
+}
+
+/**
+ * Edge-triggered backends report an fd only when its state changes.
+ * If a handler stopped before it got EAGAIN, it calls rearm() and the fd
+ * will be reported again by the next wait() without waiting for a new edge.
+ * Does nothing for level-triggered backends.
+ */
+void EventLoop::rearm(int fd, short events)
+{
+	if (!_edgeTriggered)
+		return ;
+	for (struct pollfd& pfd : _rearmed)
+	{
+		if (pfd.fd == fd)
+		{
+			pfd.revents |= events;
+			return ;
+		}
+	}
+	_rearmed.push_back({fd, events, events});
+}
+
+void EventLoop::mergeRearmedEvents()
+{
+	for (struct pollfd& rearmed : _rearmed)
+	{
+		bool merged = false;
+		for (struct pollfd& pfd : _ready)
+		{
+			if (pfd.fd == rearmed.fd)
+			{
+				pfd.revents |= rearmed.revents;
+				merged = true;
+				break ;
+			}
+		}
+		if (!merged)
+			_ready.push_back(rearmed);
+	}
+	_rearmed.clear();
+}
+
+bool EventLoop::isEdgeTriggered() const
+{
+	return _edgeTriggered;
+}
+
+/* Called before add(), readiness backends poll every fd the same way */
+void EventLoop::setKind(int fd, FdKind kind)
+{
+	(void)fd;
+	(void)kind;
+}
+
+/**
+ * Accepted sockets are non-blocking, so a slow peer can not stall the event loop.
+ * Returns -1 with errno set when nothing was accepted, the listener is kept open
+ */
+int EventLoop::accept(int listenFd)
+{
+	return accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+ssize_t EventLoop::receive(int fd, char* buffer, size_t size)
+{
+	return read(fd, buffer, size);
+}
+
+/**
+ * Returns what writev() returns. A completion backend may queue the whole
+ * iovec and return its length right away, an error of that send is then
+ * returned by the next call
+ */
+ssize_t EventLoop::send(int fd, const struct iovec* iov, int count, SendBuffers buffers)
+{
+	(void)buffers;
+	return writev(fd, iov, count);
+}
+
+ssize_t EventLoop::sendFile(int fd, int fileFd, off_t* offset, size_t count)
+{
+	return sendfile(fd, fileFd, offset, count);
+}
+
+/**
+ * Creates the backend by its config name. io_uring falls back to epoll when
+ * it is not built in or the kernel does not allow it, epoll falls back to poll
+ */
+std::shared_ptr<EventLoop> EventLoop::create(const std::string& backend, bool edgeTriggered)
+{
+	if (backend == "io_uring")
+	{
+#ifdef WEBSERV_URING
+		try
+		{
+			if (edgeTriggered)
+				LOG_WARNING("io_uring backend is level-triggered, edgeTriggered is ignored");
+			return std::make_shared<UringLoop>();
+		}
+		catch (const ServerException& e)
+		{
+			LOG_WARNING("io_uring is not available (", e.what(), "), falling back to epoll");
+		}
+#else
+		LOG_WARNING("io_uring support is not built in (make URING=1), falling back to epoll");
+#endif
+	}
+	if (backend == "epoll" || backend == "io_uring")
+	{
+		try
+		{
+			return std::make_shared<EpollLoop>(edgeTriggered);
+		}
+		catch (const ServerException& e)
+		{
+			LOG_WARNING("epoll is not available (", e.what(), "), falling back to poll");
+		}
+	}
+	return std::make_shared<PollLoop>();
+}
@@ -0,0 +1,87 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EventLoop.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/14 12:10:41 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/04 11:20:05 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "../utils/logUtils.hpp"
+#include "../utils/ServerException.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <poll.h> // POLLIN, POLLOUT, POLLERR, POLLHUP
+#include <sys/socket.h> // accept4()
+#include <sys/sendfile.h> // sendfile()
+#include <sys/uio.h> // writev()
+#include <unistd.h> // read()
+
+/**
+ * Readiness notification interface used by ServersManager.
+ * Events are described with the poll() flags (POLLIN, POLLOUT, POLLERR, POLLHUP)
+ * whatever backend is used underneath.
+ *
+ * wait() fills the list of ready fds only, so the cost of handling a tick
+ * depends on the number of ready fds and not on the number of registered ones.
+ * The list stays valid until the next wait() call. When an fd is removed,
+ * its events that are still waiting in the list are cleared, so it is safe
+ * to add and remove fds while iterating over the ready list.
+ *
+ * Listeners and client sockets are accepted, read and written through the
+ * loop, CGI stdout pipes are read through it. Readiness backends make the plain syscalls, a completion backend runs
+ * them in the kernel between two wait() calls and hands over the results.
+ */
+class EventLoop
+{
+	public:
+		/* Buffers an iovec of send() points into, a completion backend keeps them alive until they are sent */
+		using SendBuffers = std::vector<std::shared_ptr<const std::string>>;
+
+		/* What the fd is used for, a completion backend accepts or receives on it instead of polling it */
+		enum class FdKind
+		{
+			POLL,
+			LISTENER,
+			STREAM,
+			PIPE // read end of a CGI stdout pipe
+		};
+
+	protected:
+		std::vector<struct pollfd>			_ready;
+		std::vector<struct pollfd>			_rearmed;
+		bool								_edgeTriggered;
+
+		void								dropReadyEvents(int fd);
+		void								mergeRearmedEvents();
+
+	public:
+		EventLoop(bool edgeTriggered = false);
+		virtual ~EventLoop() = default;
+		EventLoop(const EventLoop&) = delete;
+		EventLoop& operator=(const EventLoop&) = delete;
+
+		virtual void						add(int fd, short events) = 0;
+		virtual void						modify(int fd, short events) = 0;
+		virtual void						remove(int fd) = 0;
+		virtual std::vector<struct pollfd>&	wait(int timeoutMs) = 0;
+		virtual std::string					getName() const = 0;
+
+		virtual void						setKind(int fd, FdKind kind);
+		virtual int							accept(int listenFd);
+		virtual ssize_t						receive(int fd, char* buffer, size_t size);
+		virtual ssize_t						send(int fd, const struct iovec* iov, int count, SendBuffers buffers);
+		virtual ssize_t						sendFile(int fd, int fileFd, off_t* offset, size_t count);
+
+		void								rearm(int fd, short events);
+		bool								isEdgeTriggered() const;
+
+		static std::shared_ptr<EventLoop>	create(const std::string& backend, bool edgeTriggered);
+};
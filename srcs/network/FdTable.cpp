@@ -0,0 +1,37 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FdTable.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/15 10:24:03 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/26 11:32:18 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FdTable.hpp"
+
+const FdTable::Entry FdTable::_emptyEntry;
+
+void FdTable::set(int fd, FdRole role, Server* server, ClientHandle client)
+{
+	if (fd < 0)
+		return ;
+	if (static_cast<size_t>(fd) >= _entries.size())
+		_entries.resize(fd + 1);
+	_entries[fd] = {role, server, client};
+}
+
+void FdTable::clear(int fd)
+{
+	if (fd >= 0 && static_cast<size_t>(fd) < _entries.size())
+		_entries[fd] = _emptyEntry;
+}
+
+const FdTable::Entry& FdTable::get(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _entries.size())
+		return _emptyEntry;
+	return _entries[fd];
+}
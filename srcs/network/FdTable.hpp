@@ -0,0 +1,56 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FdTable.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/15 10:24:03 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "Client.hpp"
+
+class Server;
+
+/**
+ * Dispatch table indexed by fd. Tells the event loop which Server owns an fd
+ * and what the fd is used for, so a ready fd is dispatched without scanning
+ * servers and their clients. Client sockets and CGI pipes keep the handle of
+ * their client, so an event left for a closed client is not routed to the
+ * client which reused its slot.
+ */
+class FdTable
+{
+	public:
+		enum class FdRole
+		{
+			NONE,
+			LISTENER,
+			CLIENT,
+			CGI_STDIN,
+			CGI_STDOUT,
+			FILE_CACHE // inotify fd of the process file cache
+		};
+
+		struct Entry
+		{
+			FdRole		role = FdRole::NONE;
+			Server*		server = nullptr;
+			ClientHandle	client;
+		};
+
+	private:
+		std::vector<Entry>	_entries;
+		static const Entry	_emptyEntry;
+
+	public:
+		void				set(int fd, FdRole role, Server* server, ClientHandle client = ClientHandle());
+		void				clear(int fd);
+		const Entry&		get(int fd) const;
+};
@@ -0,0 +1,87 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PollLoop.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/14 12:10:41 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/14 12:10:41 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "PollLoop.hpp"
+
+PollLoop::PollLoop() : EventLoop(false)
+{
+	LOG_DEBUG("PollLoop constructor called");
+}
+
+PollLoop::~PollLoop()
+{
+	LOG_DEBUG("PollLoop destructor called");
+}
+
+void PollLoop::add(int fd, short events)
+{
+	auto it = _positions.find(fd);
+	if (it != _positions.end())
+	{
+		_fds[it->second].events = events;
+		return ;
+	}
+	_positions[fd] = _fds.size();
+	_fds.push_back({fd, events, 0});
+}
+
+void PollLoop::modify(int fd, short events)
+{
+	auto it = _positions.find(fd);
+	if (it != _positions.end())
+		_fds[it->second].events = events;
+}
+
+/* Swaps the removed fd with the last one, so removing does not shift the whole vector */
+void PollLoop::remove(int fd)
+{
+	auto it = _positions.find(fd);
+	if (it == _positions.end())
+		return ;
+	size_t position = it->second;
+	_positions.erase(it);
+	if (position != _fds.size() - 1)
+	{
+		_fds[position] = _fds.back();
+		_positions[_fds[position].fd] = position;
+	}
+	_fds.pop_back();
+	dropReadyEvents(fd);
+}
+
+std::vector<struct pollfd>& PollLoop::wait(int timeoutMs)
+{
+	_ready.clear();
+	int ready = poll(_fds.data(), _fds.size(), timeoutMs);
+	if (ready == -1)
+	{
+		if (errno == EINTR)
+			return _ready;
+		throw ServerException("poll() error");
+	}
+	for (struct pollfd& pfd : _fds)
+	{
+		if (ready == 0)
+			break ;
+		if (pfd.revents != 0)
+		{
+			_ready.push_back(pfd);
+			ready--;
+		}
+	}
+	return _ready;
+}
+
+std::string PollLoop::getName() const
+{
+	return "poll";
+}
@@ -0,0 +1,35 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PollLoop.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/14 12:10:41 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/14 12:10:41 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "EventLoop.hpp"
+#include <unordered_map>
+#include <errno.h>
+
+/* poll() backend: level-triggered, every registered fd is passed to the kernel on each tick */
+class PollLoop : public EventLoop
+{
+	private:
+		std::vector<struct pollfd>			_fds;
+		std::unordered_map<int, size_t>		_positions; // fd -> index in _fds
+
+	public:
+		PollLoop();
+		~PollLoop();
+
+		void								add(int fd, short events) override;
+		void								modify(int fd, short events) override;
+		void								remove(int fd) override;
+		std::vector<struct pollfd>&			wait(int timeoutMs) override;
+		std::string							getName() const override;
+};
@@ -0,0 +1,57 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ReactorsManager.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/21 16:12:40 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ReactorsManager.hpp"
+
+/* Exceptions of a single event loop are passed to the caller as before */
+int ReactorsManager::run(size_t reactorsCount)
+{
+	if (reactorsCount <= 1)
+	{
+		ServersManager manager;
+		manager.run();
+		FileCache::logStats();
+		return EXIT_SUCCESS;
+	}
+
+	LOG_INFO("Starting ", reactorsCount, " event loop threads");
+	std::atomic<size_t> failedCount(0);
+	std::vector<std::thread> reactors;
+	for (size_t index = 0; index < reactorsCount; index++)
+		reactors.emplace_back(runReactor, index, std::ref(failedCount));
+	for (std::thread& reactor : reactors)
+		reactor.join();
+
+	LOG_INFO("All event loop threads stopped");
+	FileCache::logStats();
+	return failedCount.load() == reactorsCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* A thread which fails does not stop the other ones, they keep serving their share of connections */
+void ReactorsManager::runReactor(size_t index, std::atomic<size_t>& failedCount)
+{
+	try
+	{
+		ServersManager manager;
+		manager.run();
+	}
+	catch (const ServerException& e)
+	{
+		LOG_ERROR("Event loop thread #", index, " closed with error: ", e.what(), ", errno: ", e.getErrno());
+		failedCount++;
+	}
+	catch (const std::exception& e)
+	{
+		LOG_ERROR("Event loop thread #", index, " closed with exception: ", e.what());
+		failedCount++;
+	}
+}
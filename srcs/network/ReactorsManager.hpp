@@ -0,0 +1,37 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ReactorsManager.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/21 16:12:40 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/21 16:12:40 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "ServersManager.hpp"
+#include "../utils/logUtils.hpp"
+#include "../utils/globals.hpp"
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+/**
+ * Runs the event loops of one process. With one loop it runs in the calling
+ * thread, otherwise every loop gets its own thread, which builds and owns its
+ * own ServersManager. The threads only share the read-only config and
+ * g_signalReceived, which stops all of them
+ */
+class ReactorsManager
+{
+	private:
+		static void					runReactor(size_t index, std::atomic<size_t>& failedCount);
+
+	public:
+		ReactorsManager()			= delete;
+		static int					run(size_t reactorsCount);
+};
@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/06/20 11:20:56 by ixu               #+#    #+#             */
-/*   Updated: 2024/08/13 10:46:50 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/10/04 14:12:37 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -31,10 +31,13 @@ void Server::initServer(const char *ipAddr, int port)
 		throw ServerException("getaddrinfo error");
 	}
 
-	_serverSocket.bindAddress(_res);
+	const MainConfig* mainConfig = _webservConfig ? &_webservConfig->getMainConfig() : nullptr;
+	_serverSocket.bindAddress(_res, mainConfig && (mainConfig->workers > 1 || mainConfig->threads > 1));
 	freeaddrinfo(_res);
 
-	_serverSocket.listenForConnections(10);
+	_serverSocket.setListenerOptions(_socketOptions);
+	// Connection bursts queue in the kernel until accepter() drains them
+	_serverSocket.listenForConnections(_socketOptions.listenBacklog);
 	
 	std::string folder = "cgi-bin/";
 	_CGIBinFolder = _webservConfig->normalizeFilePath(folder, true);
@@ -50,7 +53,8 @@ Server::Server() : _serverSocket(Socket()), _webservConfig(nullptr)
 	initServer(nullptr, 8080);
 }
 
-Server::Server(const char *ipAddr, int port, std::shared_ptr<Config> webservConfig) : _serverSocket(Socket()), _webservConfig(webservConfig)
+Server::Server(const char *ipAddr, int port, std::shared_ptr<const Config> webservConfig, const SocketOptions& socketOptions)
+	: _serverSocket(Socket()), _socketOptions(socketOptions), _webservConfig(webservConfig)
 {
 	
 	LOG_DEBUG("Server parameterized constructor called");
@@ -63,116 +67,72 @@ Server::~Server()
 {
 	LOG_DEBUG("Server destructor called");
 
-	for (Client &client : _clients)
+	for (size_t slot = 0; slot < _clients.capacity(); slot++)
 	{
-		close(client.getFd());
+		if (_clients.hotAt(slot).fd != -1)
+			close(_clients.hotAt(slot).fd);
 	}
 }
 
-int Server::accepter()
+/* Returns nullptr with errno set by accept() when there is no connection to take */
+Client* Server::accepter()
 {
 	LOG_DEBUG("Server::accepter() called");
 
-	struct sockaddr_in clientAddr;
-	int clientSockfd = _serverSocket.acceptConnection(clientAddr);
-		
+	int clientSockfd = _eventLoop->accept(getServerSockfd());
+	if (clientSockfd < 0)
+		return nullptr;
+	Socket::setClientOptions(clientSockfd, _socketOptions);
+
 	LOG_INFO("Connection established with client (socket fd: ", clientSockfd, ")");
 
-	Client newClient;
+	Client& newClient = _clients.acquire();
 	newClient.setFd(clientSockfd);
-	_clients.push_back(newClient);
+	newClient.setKeepAliveTimeout(_configs[0].keepaliveTimeout);
 
-	return clientSockfd;
-}
-
-int Server::findContentLength(std::string request)
-{
-	std::string contentLength = "content-length:";
-
-	request = Utility::strToLower(request);
-	unsigned long contentLengthPos = request.find(contentLength);
-	if (contentLengthPos != std::string::npos)
-	{
-		std::string contentLengthValue = request.substr(contentLengthPos + contentLength.length());
-		int contentLengthValueEnd = contentLengthValue.find("\r\n");
-		contentLengthValue = contentLengthValue.substr(0, contentLengthValueEnd);
-		return std::stoi(Utility::trim(contentLengthValue));
-	}
-	return 0;
+	return &newClient;
 }
 
 /* When headers and start line are read in receiveRequest, maxClientBodySize can be found */
-size_t Server::findMaxClientBodyBytes(std::shared_ptr<Request> request)
+size_t Server::findMaxClientBodyBytes(const std::string& host)
 {
-
-	ServerConfig *serverConfig = findServerConfig(request);
-	std::string sizeString = serverConfig->clientMaxBodySize;
-
-	// Parse the numeric part of the string
-	size_t multiplier = 1;
-	int numericValue = std::stoi(sizeString);
-
-	// Determine multiplier based on the suffix
-	char suffix = std::toupper(sizeString.back());
-	switch (suffix)
-	{
-	case 'G':
-		multiplier *= 1024;
-		[[fallthrough]];
-	case 'M':
-		multiplier *= 1024;
-		[[fallthrough]];
-	case 'K':
-		multiplier *= 1024;
-		[[fallthrough]];
-	case 'B':
-		break;
-	default:
-		break;
-	}
-
-	return static_cast<size_t>(numericValue * multiplier);
+	return Utility::sizeToBytes(findServerConfig(host)->clientMaxBodySize);
 }
 
-void Server::receiveHeaders(Client &client, std::regex pattern)
+/**
+ * The client's parser goes on from where the previous read stopped. A body
+ * announced larger than maxClientBodySize is refused as soon as the headers
+ * are in, a chunked one once its decoded size would grow past it. A body
+ * larger than clientBodyBufferSize is spooled to clientBodyTempPath
+ */
+void Server::parseRequest(Client &client)
 {
-	// Check if the request is complete (ends with "\r\n\r\n")
-	if (!client.getIsHeadersRead() && client.getRequestString().find("\r\n\r\n") != std::string::npos)
+	RequestParser& parser = client.getParser();
+	bool isComplete = parser.parse(client.getRequestString(), client.getRequestBody());
+
+	if (!client.getIsHeadersRead() && parser.isHeadersDone())
 	{
-		client.setEmptyLinePos(client.getRequestString().find("\r\n\r\n"));
+		client.setEmptyLinePos(parser.getHeadersEnd() - 4);
 		client.setEmptyLinesSize(4);
 		client.setIsHeadersRead(true);
-		client.setContentLengthNum(findContentLength(client.getRequestString()));
-		if (!std::regex_search(client.getRequestString(), pattern) && client.getContentLengthNum() == 0)
-		{
-			client.setState(Client::ClientState::READY_TO_WRITE);
-		}
-		
-		// Find maxClientBodySize
+		client.setContentLengthNum(parser.getContentLength());
 		// only calculate if the value is initial
 		if (client.getMaxClientBodyBytes() == std::numeric_limits<size_t>::max())
-			client.setMaxClientBodyBytes(findMaxClientBodyBytes(std::make_shared<Request>(client)));
-	}
-}
-
-void Server::receiveBody(Client &client, std::regex pattern)
-{
-	if (client.getIsHeadersRead() && (client.getContentLengthNum() != std::string::npos || std::regex_search(client.getRequestString(), pattern)))
-	{
-		size_t currRequestBodyBytes = client.getRequestString().length() - client.getEmptyLinePos() - client.getEmptyLinesSize();
-
-		if (currRequestBodyBytes > client.getMaxClientBodyBytes())
+			client.setMaxClientBodyBytes(findMaxClientBodyBytes(parser.getHost()));
+		if (parser.getContentLength() > client.getMaxClientBodyBytes())
 			throw ProcessingError(413, {}, "Exception has been thrown in receiveRequest() "
 											"method of Server class");
-		// Find end of chunked body
-		size_t endOfChunkedBody = client.getRequestString().find("\r\n0\r\n\r\n");
-
-		if ((client.getContentLengthNum() != 0
-				&& currRequestBodyBytes >= client.getContentLengthNum()) || endOfChunkedBody != std::string::npos)
-		{
-			client.setState(Client::ClientState::READY_TO_WRITE);
-			client.setIsBodyRead(true);
-		}
+		parser.setMaxBodySize(client.getMaxClientBodyBytes());
+		client.getRequestBody().setSpool(Utility::sizeToBytes(findServerConfig(parser.getHost())->clientBodyBufferSize),
+			_webservConfig->getMainConfig().clientBodyTempPath);
+		// The body may have come in the same read as the headers
+		if (!isComplete)
+			isComplete = parser.parse(client.getRequestString(), client.getRequestBody());
+	}
+	if (isComplete)
+	{
+		client.setState(Client::ClientState::READY_TO_WRITE);
+		client.setIsBodyRead(parser.getContentLength() > 0 || parser.isChunked());
 	}
 }
 
@@ -181,37 +141,60 @@ bool Server::receiveRequest(Client &client)
 	LOG_DEBUG("Server::receiveRequest called for fd: ", client.getFd());
 	char buffer[g_bufferSize];
 	int bytesRead;
-	std::fill(buffer, buffer + g_bufferSize, 0);
-	std::regex pattern(R"(\s*transfer-encoding:\s*chunked\s*)", std::regex_constants::icase);
 
-	bytesRead = read(client.getFd(), buffer, sizeof(buffer));
-	LOG_DEBUG(TEXT_YELLOW, "bytesRead in receiveRequest())): ", bytesRead, RESET);
-
-	if (bytesRead < 0)
-		throw ProcessingError(500, {}, "receiveRequest() reading failed");
-	if (bytesRead == 0)
-		client.setState(Client::ClientState::READY_TO_WRITE);
-
-	if (client.getState() == Client::ClientState::READING)
+	client.setWouldBlock(false);
+	// A pipelined request left by the previous one on this connection is parsed before reading again
+	if (client.hasPipelinedBytes())
 	{
-		client.setRequestString(client.getRequestString() + std::string(buffer, bytesRead));
+		for (size_t slice = _pipelinedSlice; client.hasPipelinedBytes()
+			&& client.getState() == Client::ClientState::READING; slice *= 2)
+		{
+			client.takePipelinedBytes(slice);
+			parseRequest(client);
+		}
+	}
+	else
+	{
+		bytesRead = _eventLoop->receive(client.getFd(), buffer, sizeof(buffer));
+		LOG_DEBUG(TEXT_YELLOW, "bytesRead in receiveRequest())): ", bytesRead, RESET);
 
-		receiveHeaders(client, pattern);
-		receiveBody(client, pattern);
-		if (client.getState() != Client::ClientState::READY_TO_WRITE)
+		if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			client.setWouldBlock(true);
 			return false;
+		}
+		if (bytesRead < 0)
+			throw ProcessingError(500, {}, "receiveRequest() reading failed");
+		// Peer closed the connection between two requests, there is nothing to answer
+		if (bytesRead == 0 && client.getRequestString().empty())
+		{
+			LOG_INFO("Client (socket fd: ", client.getFd(), ") closed the connection");
+			ServersManager::changeStateToDeleteClient(client);
+			return false;
+		}
+		if (bytesRead == 0)
+			client.setState(Client::ClientState::READY_TO_WRITE);
+		else
+			client.appendRequestString(buffer, bytesRead);
+		client.setLastActivity(std::chrono::steady_clock::now());
+		if (client.getState() == Client::ClientState::READING)
+			parseRequest(client);
 	}
 
+	if (client.getState() != Client::ClientState::READY_TO_WRITE)
+		return false;
+	keepPipelinedBytes(client);
+
 	LOG_INFO("Request read");
 	LOG_DEBUG(TEXT_YELLOW, client.getRequestString().substr(0, 1000), "\n...\n", RESET, "\n");
 	return true;
 }
 
-bool Server::handler(std::shared_ptr<Server> &server, Client &client)
+bool Server::handler(Client &client)
 {
 	try
 	{
-		if (server->receiveRequest(client))
+		if (receiveRequest(client))
 			client.setRequest(std::make_shared<Request>(client));
 	}
 	catch (ProcessingError &e) // For example, maxClientBodySize exceeded
@@ -242,26 +225,34 @@ std::shared_ptr<Response> Server::createResponse(std::shared_ptr<Request> reques
 	return std::make_shared<Response>(code, findServerConfig(request), optionalHeaders);
 }
 
+/* At most g_bufferSize bytes leave per call, in one writev() or sendfile() over the client's output chain */
 bool Server::sendResponse(Client &client)
 {
-	size_t bytesToWrite = client.getResponseString().length();
-
-	// Calculate the remaining bytes to write
-	size_t remainingBytes = bytesToWrite - client.getTotalBytesWritten();
-	// Limit the chunk size to the remaining bytes
-	size_t bytesToWriteNow = remainingBytes < g_bufferSize ? remainingBytes : g_bufferSize;
+	OutputChain& output = client.getOutput();
 
-	ssize_t bytesWritten = write(client.getFd(), client.getResponseString().c_str() + client.getTotalBytesWritten(), bytesToWriteNow);
+	client.setWouldBlock(false);
+	// Headers and body written in several calls still leave in full segments
+	if (_socketOptions.tcpCork && client.getTotalBytesWritten() == 0)
+		Socket::setCork(client.getFd(), true);
+	ssize_t bytesWritten = output.writeTo(*_eventLoop, client.getFd(), g_bufferSize);
 	LOG_DEBUG(TEXT_GREEN, "Bytes written: ", bytesWritten, RESET);
 
+	if (bytesWritten == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		client.setWouldBlock(true);
+		return false;
+	}
 	if (bytesWritten == -1)
 		throw ProcessingError(500, {}, "sendResponse() writing failed");
 	client.setTotalBytesWritten(client.getTotalBytesWritten() + bytesWritten);
+	client.setLastActivity(std::chrono::steady_clock::now());
 	LOG_DEBUG(TEXT_GREEN, "client.totalBytesWritten: ", client.getTotalBytesWritten(), RESET);
 	
 	// Handle case where write returns 0 (should not happen with regular sockets)
-	if (bytesWritten == 0 || client.getTotalBytesWritten() == bytesToWrite)
+	if (bytesWritten == 0 || output.empty())
 	{
+		if (_socketOptions.tcpCork)
+			Socket::setCork(client.getFd(), false);
 		LOG_INFO(TEXT_GREEN, "Response written with length: ", client.getTotalBytesWritten(), RESET);
 		return true;
 	}
@@ -353,6 +344,15 @@ void Server::handleStaticFiles(Client &client, Location &foundLocation)
 {
 	std::string requestPath = client.getRequest()->getStartLine()["path"];
 	std::string filePath = foundLocation.root + requestPath.substr(foundLocation.path.length());
+
+	// A cached file was readable when it was read, any change since then has evicted it
+	std::string indexPath = requestPath.back() == '/' ? filePath + foundLocation.index : filePath;
+	if (std::shared_ptr<const FileCache::Entry> cached = FileCache::find(indexPath))
+	{
+		client.setResponse(applyRanges(client, revalidate(client, createFileResponse(client, indexPath, foundLocation, cached))));
+		return ;
+	}
+
 	if (access(filePath.c_str(), F_OK) == -1)
 		throw ProcessingError(404, {}, "Exception has been thrown in handleStaticFiles() "
 									 "method of Server class");
@@ -371,30 +371,296 @@ void Server::handleStaticFiles(Client &client, Location &foundLocation)
 				throw ProcessingError(403);
 		}
 		else if (foundLocation.autoindex)
+		{
 			locationResp = DirLister::createDirListResponse(foundLocation, requestPath);
+			compressResponse(client, *locationResp, foundLocation);
+		}
 		else
 			throw ProcessingError(404, {}, "Exception has been thrown in handleStaticFiles() "
 										 "method of Server class"); //
 	}
 
 	// Checks if location response was formed, otherwise creates Response from filePath
-	client.setResponse(locationResp ? locationResp : std::make_shared<Response>(200, filePath));
+	if (!locationResp)
+		locationResp = applyRanges(client, revalidate(client, createFileResponse(client, filePath, foundLocation)));
+	client.setResponse(locationResp);
+}
+
+/**
+ * Text files are answered with their precompressed .gz sibling when the client
+ * accepts gzip and the sibling is not older than the file itself
+ */
+std::shared_ptr<Response> Server::createFileResponse(Client& client, const std::string& filePath,
+	Location& foundLocation, std::shared_ptr<const FileCache::Entry> cached)
+{
+	std::map<std::string, std::string> headers;
+
+	if (Response::isPrecompressible(filePath))
+	{
+		headers["Vary"] = "Accept-Encoding";
+		if (client.getRequest()->acceptsEncoding("gzip"))
+		{
+			std::string gzipPath = filePath + ".gz";
+			std::map<std::string, std::string> gzipHeaders = headers;
+			gzipHeaders["Content-Encoding"] = "gzip";
+
+			std::shared_ptr<const FileCache::Entry> gzipCached = cached ? FileCache::find(gzipPath) : nullptr;
+			struct stat fileStat;
+			struct stat gzipStat;
+			std::shared_ptr<Response> gzipResp = nullptr;
+			if (gzipCached && gzipCached->modified >= cached->modified)
+				gzipResp = std::make_shared<Response>(200, gzipCached, gzipHeaders);
+			else if (stat(filePath.c_str(), &fileStat) == 0 && stat(gzipPath.c_str(), &gzipStat) == 0
+				&& S_ISREG(gzipStat.st_mode) && gzipStat.st_mtime >= fileStat.st_mtime
+				&& access(gzipPath.c_str(), R_OK) == 0)
+			{
+				gzipResp = std::make_shared<Response>(200, gzipPath, gzipHeaders, foundLocation.sendfileThreshold);
+				gzipResp->setValidators(gzipStat);
+			}
+			if (gzipResp)
+			{
+				gzipResp->setType(Response::findType(filePath));
+				return gzipResp;
+			}
+		}
+	}
+	std::shared_ptr<Response> response = cached ? std::make_shared<Response>(200, cached, headers)
+		: std::make_shared<Response>(200, filePath, headers, foundLocation.sendfileThreshold);
+	struct stat fileStat;
+	if (!cached && stat(filePath.c_str(), &fileStat) == 0)
+		response->setValidators(fileStat);
+	compressFileResponse(client, *response, foundLocation, filePath, cached);
+	return response;
+}
+
+/**
+ * Answers a conditional GET with a header-only 304 when the client's copy is
+ * current. If-None-Match is checked with the weak comparison and overrides
+ * If-Modified-Since, as in RFC 9110
+ */
+std::shared_ptr<Response> Server::revalidate(Client& client, std::shared_ptr<Response> response)
+{
+	std::string method = client.getRequest()->getStartLine()["method"];
+	std::map<std::string, std::string> headers = client.getRequest()->getHeaders();
+	std::string etag = response->getHeader("ETag");
+	std::string lastModified = response->getHeader("Last-Modified");
+
+	if ((method != "GET" && method != "HEAD") || etag.empty())
+		return response;
+
+	bool notModified = false;
+	if (headers.find("if-none-match") != headers.end())
+	{
+		std::string ownTag = etag.compare(0, 2, "W/") == 0 ? etag.substr(2) : etag;
+		for (std::string tag : Utility::splitStr(headers["if-none-match"], ","))
+		{
+			tag = Utility::trim(tag);
+			if (tag.compare(0, 2, "W/") == 0)
+				tag = tag.substr(2);
+			if (tag == "*" || tag == ownTag)
+				notModified = true;
+		}
+	}
+	else if (headers.find("if-modified-since") != headers.end())
+	{
+		time_t since;
+		time_t modified;
+		notModified = Utility::parseDate(Utility::trim(headers["if-modified-since"]), since)
+			&& Utility::parseDate(lastModified, modified) && modified <= since;
+	}
+	if (!notModified)
+		return response;
+
+	LOG_DEBUG("Not modified since the client's copy: ", etag);
+	std::map<std::string, std::string> notModifiedHeaders = {{"ETag", etag}, {"Last-Modified", lastModified}};
+	if (!response->getHeader("Vary").empty())
+		notModifiedHeaders["Vary"] = response->getHeader("Vary");
+	return std::make_shared<Response>(304, "", notModifiedHeaders);
+}
+
+/**
+ * Serves the parts of a static file asked for with Range, from its buffer or
+ * its fd. An If-Range which no longer matches, or a malformed Range, gets the
+ * whole file; ranges all past the end of the file get a 416
+ */
+std::shared_ptr<Response> Server::applyRanges(Client& client, std::shared_ptr<Response> response)
+{
+	if (response->getStatusCode() != 200 || response->getHeader("ETag").empty())
+		return response;
+	response->setHeader("Accept-Ranges", "bytes");
+
+	std::map<std::string, std::string> headers = client.getRequest()->getHeaders();
+	if (client.getRequest()->getStartLine()["method"] != "GET" || headers.find("range") == headers.end())
+		return response;
+	if (headers.find("if-range") != headers.end())
+	{
+		// Only a strong tag or the exact date of the current file lets the ranges through
+		std::string condition = Utility::trim(headers["if-range"]);
+		time_t since;
+		time_t modified;
+		bool dateMatches = Utility::parseDate(condition, since)
+			&& Utility::parseDate(response->getHeader("Last-Modified"), modified) && since == modified;
+		if (condition != response->getHeader("ETag") && !dateMatches)
+			return response;
+	}
+
+	std::vector<Response::Range> ranges;
+	if (!Response::parseRanges(headers["range"], response->getBodySize(), ranges))
+		return response;
+	if (ranges.empty())
+		throw ProcessingError(416, {{"Content-Range", "bytes */" + std::to_string(response->getBodySize())}},
+			"Exception has been thrown in applyRanges() method of Server class");
+	response->setRanges(std::move(ranges));
+	return response;
+}
+
+/**
+ * Sets Vary on the bodies of the types the location compresses, true when
+ * this body is large enough and the client accepts gzip
+ */
+bool Server::shouldCompress(Client& client, Response& response, const Location& location)
+{
+	size_t size = response.getFile() ? response.getFile()->getSize() : response.getBody().size();
+	std::string type = response.getType().substr(0, response.getType().find(';'));
+
+	if (!location.gzip || !response.getHeader("Content-Encoding").empty() || location.gzipTypes.count(type) == 0)
+		return false;
+	response.setHeader("Vary", "Accept-Encoding");
+	// Bodies are compressed on the event loop thread, larger ones would hold up every other client
+	return size >= location.gzipMinLength && size <= location.gzipMaxLength
+		&& client.getRequest()->acceptsEncoding("gzip");
+}
+
+/* Directory listings and script output are compressed for every response */
+void Server::compressResponse(Client& client, Response& response, const Location& location)
+{
+	if (!shouldCompress(client, response, location))
+		return ;
+	response.setBody(GzipStream::compress(response.getBody(), location.gzipLevel));
+	response.setContentLength(response.getBody().size());
+	response.setHeader("Content-Encoding", "gzip");
+}
+
+void Server::compressCGIResponse(Client& client)
+{
+	compressResponse(client, *client.getResponse(), findLocation(client.getRequest()));
+}
+
+/**
+ * The gzip variant of a static file is cached by path and mtime, so a version
+ * of the file is compressed once as long as its variant stays in the file
+ * cache. A variant which does not fit (or any, with fileCacheSize off) is made
+ * again for every response, gzipMaxLength bounds that work. Files sent with
+ * sendfile() are read from their open fd in chunks, the compressed body is
+ * kept in memory
+ */
+void Server::compressFileResponse(Client& client, Response& response, const Location& location,
+	const std::string& filePath, std::shared_ptr<const FileCache::Entry> cached)
+{
+	if (!shouldCompress(client, response, location))
+		return ;
+
+	struct stat fileStat = {};
+	if (cached)
+		fileStat.st_mtime = cached->modified;
+	else if (response.getFile())
+		fstat(response.getFile()->getFd(), &fileStat);
+	else
+		stat(filePath.c_str(), &fileStat);
+
+	std::shared_ptr<const FileCache::Entry> variant = FileCache::findGzip(filePath, fileStat.st_mtime);
+	if (!variant)
+	{
+		size_t generation = FileCache::prepareGzip(filePath);
+		std::shared_ptr<FileCache::Entry> entry = std::make_shared<FileCache::Entry>();
+		entry->content = std::make_shared<const std::string>(response.getFile()
+			? GzipStream::compressFile(response.getFile()->getFd(), response.getFile()->getSize(), location.gzipLevel)
+			: GzipStream::compress(response.getBody(), location.gzipLevel));
+		entry->type = response.getType();
+		// The gzip encoding is another representation of the file, it gets a tag of its own
+		entry->etag = response.getHeader("ETag");
+		if (!entry->etag.empty())
+			entry->etag.insert(entry->etag.size() - 1, "-gzip");
+		entry->lastModified = response.getHeader("Last-Modified");
+		entry->modified = fileStat.st_mtime;
+		FileCache::storeGzip(filePath, entry, generation);
+		variant = entry;
+	}
+	response.setBody(variant->content);
+	response.setContentLength(variant->content->size());
+	response.setHeader("Content-Encoding", "gzip");
+	if (!variant->etag.empty())
+		response.setHeader("ETag", variant->etag);
+}
+
+/* Bytes after the end of the current request belong to the next one and are kept on the client */
+void Server::keepPipelinedBytes(Client &client)
+{
+	size_t requestEnd = client.getParser().getRequestEnd();
+
+	if (client.getParser().getState() != RequestParser::State::DONE || requestEnd >= client.getRequestString().length())
+		return ;
+	LOG_DEBUG("Pipelined bytes kept for the next request: ", client.getRequestString().length() - requestEnd);
+	client.keepPipelinedBytes(requestEnd);
+}
+
+/**
+ * The connection is kept open for HTTP/1.1 requests which were read completely,
+ * unless the client asked to close it or the connection used up keepaliveRequests
+ */
+bool Server::isKeepAlive(Client &client)
+{
+	std::shared_ptr<Request> request = client.getRequest();
+	if (!request || !client.getIsHeadersRead())
+		return false;
+	if (!client.getIsBodyRead() && (client.getContentLengthNum() != 0
+		|| !request->getHeaders()["transfer-encoding"].empty()))
+		return false;
+	if (request->getStartLine()["version"] != "HTTP/1.1"
+		|| Utility::strToLower(request->getHeaders()["connection"]).find("close") != std::string::npos)
+		return false;
+
+	ServerConfig *serverConfig = findServerConfig(request);
+	if (serverConfig->keepaliveTimeout <= 0
+		|| client.getRequestsServed() + 1 >= static_cast<size_t>(serverConfig->keepaliveRequests))
+		return false;
+	client.setKeepAliveTimeout(serverConfig->keepaliveTimeout);
+	return true;
+}
+
+/* Closes what is left of a CGI run and brings the client back to READING without closing the socket */
+void Server::resetClient(Client &client)
+{
+	if (client.getChildPipe(0) != -1 || client.getParentPipe(1) != -1)
+	{
+		unwatchFd(client.getChildPipe(0));
+		unwatchFd(client.getParentPipe(1));
+		CGIHandler::closeFds(client);
+		CGIHandler::setToInit(client);
+	}
+	client.resetForNextRequest();
 }
 
 void Server::finalizeResponse(Client &client)
 {
 	client.setRequest(nullptr);
 	client.setResponse(nullptr);
-	LOG_DEBUG("closing fd: ", client.getFd());
-	close(client.getFd());
+	int clientFd = client.getFd();
+	// fds are removed from the event loop before closing, a CGI child may still hold copies of them
+	LOG_DEBUG("removing from event loop fd: ", clientFd);
+	unwatchFd(clientFd);
+	LOG_DEBUG("closing fd: ", clientFd);
+	close(clientFd);
 	if (client.getChildPipe(0) != -1)
+	{
+		unwatchFd(client.getChildPipe(0));
+		unwatchFd(client.getParentPipe(1));
 		CGIHandler::closeFds(client);
-	LOG_DEBUG("removing from poll fd: ", client.getFd());
-	ServersManager::removeFromPollfd(client.getFd());
-	if (client.getChildPipe(0) != -1)
 		CGIHandler::setToInit(client);
+	}
 	client.setFd(-1);
-	removeFromClients(client);
+	// The client object is destroyed here, its slot goes to the next connection
+	_clients.release(client.getHandle());
 }
 
 void Server::validateRequest(Client &client)
@@ -411,27 +677,22 @@ void Server::validateRequest(Client &client)
 		throw ProcessingError(505, {}, "Wrong HTTP version in the start line");
 }
 
+/* Called by the timer wheel when the script outlived cgiTimeout, the client gets 504 */
 void Server::handleCGITimeout(Client &client)
 {
 	LOG_DEBUG("handleCGITimeout() called");
 
-	auto cgiEnd = std::chrono::system_clock::now();
+	if (client.getCGIState() != Client::CGIState::FORKED)
+		return ;
+	LOG_WARNING("Cgi has been timeouted");
+	CGIHandler::killScript(client);
+	CGIHandler::changeToErrorState(client);
 
-	std::chrono::duration<double> elapsed_seconds = cgiEnd - client.getCgiStart();
+	unwatchFd(client.getChildPipe(0));
+	close(client.getChildPipe(0));
+	client.setChildPipe(0, -1);
 
-	if (elapsed_seconds.count() >= g_timeout && client.getCGIState() == Client::CGIState::FORKED)
-	{
-		LOG_WARNING("Cgi has been timeouted");
-		kill(client.getPid(), SIGTERM);
-		CGIHandler::removeFromPids(client.getPid());
-		CGIHandler::changeToErrorState(client);
-		
-		close(client.getChildPipe(0));
-		ServersManager::removeFromPollfd(client.getChildPipe(0));
-		client.setChildPipe(0, -1);
-		
-		client.setResponse(createResponse(client.getRequest(), 504));
-	}
+	client.setResponse(createResponse(client.getRequest(), 504));
 }
 
 void Server::responder(Client &client, Server &server)
@@ -445,7 +706,6 @@ void Server::responder(Client &client, Server &server)
 	try
 	{
 		validateRequest(client);
-		handleCGITimeout(client);
 
 		if (client.getRequest()->getStartLine()["path"].rfind("/cgi-bin/", 0) == 0 && client.getCGIState() == Client::CGIState::INIT)
 		{
@@ -475,17 +735,25 @@ void Server::responder(Client &client, Server &server)
 		client.setResponse(createResponse(client.getRequest(), 500));
 }
 
-void Server::removeFromClients(Client &client)
+/* Registers the fd in the event loop and in the fd table, which tells the manager who owns it */
+void Server::watchFd(int fd, short events, FdTable::FdRole role, ClientHandle client)
 {
-	// remove from _clients vector
-	for (auto it = _clients.begin(); it != _clients.end(); ++it)
-	{
-		if (&(*it) == &client)
-		{
-			_clients.erase(it);
-			break;
-		}
-	}
+	if (role == FdTable::FdRole::LISTENER)
+		_eventLoop->setKind(fd, EventLoop::FdKind::LISTENER);
+	else if (role == FdTable::FdRole::CLIENT)
+		_eventLoop->setKind(fd, EventLoop::FdKind::STREAM);
+	else if (role == FdTable::FdRole::CGI_STDOUT)
+		_eventLoop->setKind(fd, EventLoop::FdKind::PIPE);
+	_eventLoop->add(fd, events);
+	_fdTable->set(fd, role, this, client);
+}
+
+void Server::unwatchFd(int fd)
+{
+	if (fd < 0)
+		return ;
+	_eventLoop->remove(fd);
+	_fdTable->clear(fd);
 }
 
 std::string Server::whoAmI() const
@@ -495,13 +763,19 @@ std::string Server::whoAmI() const
 
 /** If no match found, the first config will be used */
 ServerConfig *Server::findServerConfig(std::shared_ptr<Request> req)
+{
+	return findServerConfig(req ? req->getHeaders()["host"] : std::string());
+}
+
+/* Host header value of the request, empty when there is none */
+ServerConfig *Server::findServerConfig(const std::string& host)
 {
 	// If request host is an ip address:port or if the ip is not specified for current server,
 	// the first config for the server is used
-	if (!req || req->getHeaders()["host"].empty())
+	if (host.empty())
 		return &_configs[0];
 
-	std::vector<std::string> hostSplit = Utility::splitStr(req->getHeaders()["host"], ":");
+	std::vector<std::string> hostSplit = Utility::splitStr(host, ":");
 	std::string reqPort = "80"; // Default port for HTTP
 	std::string reqHost;
 
@@ -525,7 +799,7 @@ ServerConfig *Server::findServerConfig(std::shared_ptr<Request> req)
 		}
 	}
 
-	if (whoAmI() == req->getHeaders()["host"] ||
+	if (whoAmI() == host ||
 		(_ipAddr.empty() && std::to_string(_port) == reqPort))
 	{
 		if (!_configs.empty())
@@ -638,11 +912,16 @@ int Server::getServerSockfd()
 	return _serverSocket.getSockfd();
 }
 
-std::vector<Client> &Server::getClients()
+ClientPool &Server::getClients()
 {
 	return _clients;
 }
 
+Client *Server::getClient(ClientHandle handle)
+{
+	return _clients.get(handle);
+}
+
 std::string Server::getIpAddress()
 {
 	return _ipAddr;
@@ -653,9 +932,9 @@ int Server::getPort()
 	return _port;
 }
 
-std::vector<struct pollfd> *Server::getFds()
+std::shared_ptr<EventLoop> Server::getEventLoop()
 {
-	return _managerFds;
+	return _eventLoop;
 }
 
 std::string Server::getCGIBinFolder()
@@ -677,7 +956,12 @@ void Server::setConfig(std::vector<ServerConfig> serverConfigs)
 	_configs = serverConfigs;
 }
 
-void Server::setFds(std::vector<struct pollfd> *fds)
+void Server::setEventLoop(std::shared_ptr<EventLoop> eventLoop)
+{
+	_eventLoop = eventLoop;
+}
+
+void Server::setFdTable(std::shared_ptr<FdTable> fdTable)
 {
-	_managerFds = fds;
+	_fdTable = fdTable;
 }
@@ -6,7 +6,7 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/06/20 11:20:59 by ixu               #+#    #+#             */
-/*   Updated: 2024/08/06 15:23:22 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/04 14:12:37 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -16,6 +16,9 @@
 #include "CGIHandler.hpp"
 #include "SessionsManager.hpp"
 #include "ServersManager.hpp"
+#include "EventLoop.hpp"
+#include "FdTable.hpp"
+#include "ClientPool.hpp"
 #include "../response/Response.hpp"
 #include "../utils/Utility.hpp"
 #include "../utils/logUtils.hpp"
@@ -23,8 +26,10 @@
 #include "../utils/ServerException.hpp"
 #include "../response/DirLister.hpp"
 #include "../response/Uploader.hpp"
+#include "../response/GzipStream.hpp"
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <cstring> // memset()
 #include <signal.h> // signal()
 #include <poll.h> // poll()
@@ -40,7 +45,6 @@
 
 #include <fstream> //open file
 
-#include <regex> // to match header of chunked request
 
 class ServersManager;
 
@@ -50,66 +54,86 @@ class Server
 		Socket						_serverSocket;
 		struct addrinfo				_hints;
 		struct addrinfo*			_res;
-		std::vector<Client>			_clients;
+		ClientPool					_clients;
 		std::vector<ServerConfig>	_configs;
-		std::vector<struct pollfd>*	_managerFds;
+		SocketOptions				_socketOptions;
+		std::shared_ptr<EventLoop>	_eventLoop;
+		std::shared_ptr<FdTable>	_fdTable;
 		std::vector<std::string>	_cgiBinFiles;
 
 		std::string					_CGIBinFolder;
 		int							_port;
 		std::string					_ipAddr;
 
-		std::shared_ptr<Config>			_webservConfig;
+		std::shared_ptr<const Config>	_webservConfig;
+
+		static constexpr size_t		_pipelinedSlice = 4 * 1024; // first slice of kept bytes parsed, it doubles after
 
 	public:
 		Server();
-		Server(const char* ipAddr, int port, std::shared_ptr<Config> webservConfig);
+		Server(const char* ipAddr, int port, std::shared_ptr<const Config> webservConfig,
+			const SocketOptions& socketOptions = SocketOptions());
 		~Server();
 
 		void						setConfig(std::vector<ServerConfig> serverConfigs);
-		void						setFds(std::vector<struct pollfd>* fds);
+		void						setEventLoop(std::shared_ptr<EventLoop> eventLoop);
+		void						setFdTable(std::shared_ptr<FdTable> fdTable);
 		
 		int							getServerSockfd();
-		std::vector<Client>&		getClients();
+		ClientPool&					getClients();
+		Client*						getClient(ClientHandle handle);
 		std::string					getIpAddress();
 		int							getPort();
 		std::vector<ServerConfig>&	getConfigs();
-		std::vector<struct pollfd>*	getFds();
+		std::shared_ptr<EventLoop>	getEventLoop();
 		std::string					getCGIBinFolder();
 		std::vector<std::string>	getcgiBinFiles();
 
-		int							accepter();
-		bool						handler(std::shared_ptr<Server>& server, Client& client);
+		void						watchFd(int fd, short events, FdTable::FdRole role, ClientHandle client = ClientHandle());
+		void						unwatchFd(int fd);
+
+		Client*						accepter();
+		bool						handler(Client& client);
 		void						responder(Client& client, Server &server);
 
 		void						handleCGITimeout(Client &client);
-		void						receiveHeaders(Client &client, std::regex pattern);
-		void						receiveBody(Client &client, std::regex pattern);
+		void						parseRequest(Client &client);
+		void						keepPipelinedBytes(Client &client);
 		bool						receiveRequest(Client& client);
 		bool						sendResponse(Client& client);
 		void						finalizeResponse(Client& client);
+		bool						isKeepAlive(Client& client);
+		void						resetClient(Client& client);
 		ServerConfig*				findServerConfig(std::shared_ptr<Request> req);
+		ServerConfig*				findServerConfig(const std::string& host);
+		void						compressCGIResponse(Client& client);
 
 	private:
 		std::string					whoAmI() const;
 		void						initServer(const char* ipAddr, int port);
-		void						removeFromClients(Client& client);
 
 
 		void						validateRequest(Client& client);
-		int							findContentLength(std::string request);
 		bool						formCGIConfigAbsenceResponse(Client& client, Server &server);
 		void						handleNonCGIResponse(Client& client, Server &server);
 		void						checkIfMethodAllowed(Client& client, Location& foundLocation);
 		void						handleRedirect(Client& client, Location& foundLocation);
 		int							handleDelete(Client& client, Location& foundLocation);
 		void						handleStaticFiles(Client& client, Location& foundLocation);
+		std::shared_ptr<Response>	createFileResponse(Client& client, const std::string& filePath,
+										Location& foundLocation, std::shared_ptr<const FileCache::Entry> cached = nullptr);
+		std::shared_ptr<Response>	revalidate(Client& client, std::shared_ptr<Response> response);
+		std::shared_ptr<Response>	applyRanges(Client& client, std::shared_ptr<Response> response);
+		bool						shouldCompress(Client& client, Response& response, const Location& location);
+		void						compressResponse(Client& client, Response& response, const Location& location);
+		void						compressFileResponse(Client& client, Response& response, const Location& location,
+										const std::string& filePath, std::shared_ptr<const FileCache::Entry> cached);
 		ServerConfig*				processNamedServerConfig(std::shared_ptr<Request> req);
 		Location					findLocation(std::shared_ptr<Request> req);
 		void						listCGIFiles();
 		bool						isCGIBinExistAndReadable();
 
-		size_t						findMaxClientBodyBytes(std::shared_ptr<Request> request);
+		size_t						findMaxClientBodyBytes(const std::string& host);
 
 		std::shared_ptr<Response>	createResponse(std::shared_ptr<Request> request, int code, std::map<std::string,
 										std::string> optionalHeaders = {});
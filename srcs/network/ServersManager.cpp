@@ -6,24 +6,30 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:10:50 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/12 14:38:47 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/10/04 14:12:37 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "ServersManager.hpp"
 
-std::vector<std::shared_ptr<Server>> ServersManager::_servers;
-std::shared_ptr<ServersManager> ServersManager::_instance = nullptr;
-std::shared_ptr<Config> ServersManager::_webservConfig = nullptr;
-std::vector<struct pollfd> ServersManager::_fds;
+std::shared_ptr<const Config> ServersManager::_webservConfig = nullptr;
 
 void ServersManager::processFoundServer(std::shared_ptr<Server> foundServer, std::vector<ServerConfig> serverConfigs)
 {
+	// Listeners are bound to all interfaces, with SO_REUSEPORT a second bind to the port would not fail
+	if (!foundServer && isPortTaken(serverConfigs[0].port))
+	{
+		LOG_ERROR("Failed to launch server: port ", serverConfigs[0].port, " is already used by another server");
+		moveServerConfigsToNoIpServer(serverConfigs[0].port, serverConfigs);
+		LOG_INFO("Config for the server will be moved");
+		return ;
+	}
 	if (!foundServer)
 	{
 		try
 		{
-			_servers.push_back(std::make_shared<Server>(serverConfigs[0].ipAddress.c_str(), serverConfigs[0].port, _webservConfig));
+			_servers.push_back(std::make_shared<Server>(serverConfigs[0].ipAddress.c_str(), serverConfigs[0].port,
+				_webservConfig, serverConfigs[0].socketOptions));
 			foundServer = _servers.back();
 		}
 		catch (const ServerException& e)
@@ -54,12 +60,14 @@ void ServersManager::printServersInfo()
 
 ServersManager::ServersManager()
 {
+	if (_webservConfig == nullptr)
+		throw ServerException("Config is not initialized");
 	LOG_DEBUG("ServersManager creating servers... Servers in config: ", _webservConfig->getServersConfigsMap().size());
 
 	// Iterate according to keys because map is ordered and we can not use unordered map as the order is not guaranteed
 	for (auto& key : _webservConfig->getServersConfigsMapKeys())
 	{
-		std::vector<ServerConfig> serverConfigs = _webservConfig->getServersConfigsMap()[key];
+		std::vector<ServerConfig> serverConfigs = _webservConfig->getServersConfigsMap().at(key);
 
 		std::shared_ptr<Server> foundServer = nullptr;
 		for (auto& server : _servers)
@@ -74,22 +82,72 @@ ServersManager::ServersManager()
 		processFoundServer(foundServer, serverConfigs);
 	}
 
-	// Add all server fds to pollfd vector
-	for (std::shared_ptr<Server>& server : _servers)
-	{
-		server->setFds(&_fds);
-		_fds.push_back({server->getServerSockfd(), POLLIN, 0});
-	}	
-
 	if (_servers.empty())
 		throw ServerException("No valid servers");
 
+	// Register all server fds in the event loop
+	const MainConfig& mainConfig = _webservConfig->getMainConfig();
+	_eventLoop = EventLoop::create(mainConfig.eventLoop, mainConfig.edgeTriggered);
+	_fdTable = std::make_shared<FdTable>();
+	for (std::shared_ptr<Server>& server : _servers)
+	{
+		server->setEventLoop(_eventLoop);
+		server->setFdTable(_fdTable);
+		server->watchFd(server->getServerSockfd(), POLLIN, FdTable::FdRole::LISTENER);
+	}
+	LOG_INFO("Event loop backend: ", _eventLoop->getName(),
+		_eventLoop->isEdgeTriggered() ? " (edge-triggered)" : "");
+	watchFileCache();
+
 	printServersInfo();
 }
 
 ServersManager::~ServersManager()
 {
 	LOG_DEBUG(_servers.size(), " server(s) will be deleted");
+	killScripts();
+}
+
+/**
+ * The file cache is shared by the event loops of the process, every loop
+ * watches its inotify fd and whichever wakes first drains the events
+ */
+void ServersManager::watchFileCache()
+{
+	FileCache::init(_webservConfig->getMainConfig().fileCacheSize);
+	int inotifyFd = FileCache::getInotifyFd();
+	if (inotifyFd == -1)
+		return ;
+	_eventLoop->add(inotifyFd, POLLIN);
+	_fdTable->set(inotifyFd, FdTable::FdRole::FILE_CACHE, nullptr);
+	for (auto& [key, serverConfigs] : _webservConfig->getServersConfigsMap())
+	{
+		for (const ServerConfig& serverConfig : serverConfigs)
+		{
+			for (const Location& location : serverConfig.locations)
+			{
+				if (!location.root.empty())
+					FileCache::watchDirectory(location.root);
+			}
+		}
+	}
+}
+
+/* Scripts still running for the clients of this manager are stopped on shutdown */
+void ServersManager::killScripts()
+{
+	for (std::shared_ptr<Server>& server : _servers)
+	{
+		ClientPool& clients = server->getClients();
+		for (size_t slot = 0; slot < clients.capacity(); slot++)
+		{
+			Client* client = clients.at(slot);
+			if (!client || client->getCGIState() != Client::CGIState::FORKED || client->getPid() <= 0)
+				continue ;
+			LOG_INFO("Terminating the child process with pid [", client->getPid(), "]");
+			CGIHandler::killScript(*client);
+		}
+	}
 }
 
 std::shared_ptr<Server> ServersManager::findNoIpServerByPort(int port)
@@ -104,6 +162,16 @@ std::shared_ptr<Server> ServersManager::findNoIpServerByPort(int port)
 	return nullptr;
 }
 
+bool ServersManager::isPortTaken(int port)
+{
+	for (std::shared_ptr<Server>& server : _servers)
+	{
+		if (server->getPort() == port)
+			return true;
+	}
+	return false;
+}
+
 bool ServersManager::checkUniqueNameServer(ServerConfig& serverConfig, std::vector<ServerConfig>& targetServerconfigs)
 {
 	for (ServerConfig& targetConfig : targetServerconfigs)
@@ -127,31 +195,31 @@ void ServersManager::moveServerConfigsToNoIpServer(int port, std::vector<ServerC
 	}
 }
 
+/* The config is parsed once before any event loop starts, the managers only read it afterwards */
 void ServersManager::initConfig(const char *fileNameString, const char*argv0)
 {
-	_webservConfig = std::make_shared<Config>(fileNameString, argv0);
+	_webservConfig = std::make_shared<const Config>(fileNameString, argv0);
 }
 
-std::shared_ptr<ServersManager> ServersManager::getInstance(const char* argv0)
+const MainConfig& ServersManager::getMainConfig()
 {
-	// If config is not initialized with initConfig, DEFAULT_CONFIG will be used
-	if (_webservConfig == nullptr)
-		_webservConfig = std::make_shared<Config>(DEFAULT_CONFIG, argv0);
-
-	if (_instance == nullptr)
-		_instance = std::shared_ptr<ServersManager>(new ServersManager());
-
-	return _instance;
+	return _webservConfig->getMainConfig();
 }
 
-void ServersManager::checkRevents(std::vector<pollfd>& new_fds)
+/**
+ * readyFds holds only the fds reported by the event loop. Removing an fd from
+ * the loop clears its events in readyFds, so fds closed by an earlier handler
+ * in the same tick are skipped. A hang-up is passed to the read handler,
+ * which gets EOF from read()
+ */
+void ServersManager::checkRevents(std::vector<pollfd>& readyFds)
 {
-	for (struct pollfd& pfd : _fds)
+	for (struct pollfd& pfd : readyFds)
 	{
-		if (pfd.revents & POLLIN)
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
 		{
 			LOG_DEBUG("if POLLIN for fd: ", pfd.fd);
-			handleRead(pfd.fd, new_fds);
+			handleRead(pfd.fd);
 		}
 		if (pfd.revents & POLLOUT)
 		{
@@ -165,72 +233,253 @@ void ServersManager::run()
 {
 	while (!g_signalReceived.load())
 	{
-		std::vector<pollfd> new_fds;
-		int ready = poll(_fds.data(), _fds.size(), -1);
-		if (ready == -1)
+		// The nearest deadline decides how long the loop may sleep
+		int timeoutMs = _timers.msUntilNext(std::chrono::steady_clock::now(), _maxWaitMs);
+		if (_acceptPaused)
+			timeoutMs = std::min(timeoutMs, _acceptRetryMs);
+		std::vector<pollfd>& readyFds = _eventLoop->wait(timeoutMs);
+		checkRevents(readyFds);
+
+		auto now = std::chrono::steady_clock::now();
+		expireTimers(now);
+		if (_acceptPaused && now - _acceptPausedAt >= std::chrono::milliseconds(_acceptRetryMs))
+			resumeAccepting();
+		if (g_statsRequested.exchange(false))
+			FileCache::logStats();
+	}
+}
+
+/* The phase a client is in follows from its state, it is not tracked separately */
+Client::Phase ServersManager::findPhase(Client& client)
+{
+	if (client.getCGIState() == Client::CGIState::FORKED)
+		return Client::Phase::CGI;
+	if (client.getState() == Client::ClientState::WRITING)
+		return Client::Phase::WRITE;
+	if (client.getState() != Client::ClientState::READING)
+		return Client::Phase::NONE;
+	if (client.getIsHeadersRead())
+		return Client::Phase::BODY;
+	// A kept-alive connection is idle until the first byte of the next request comes
+	if (client.getRequestsServed() > 0 && client.getRequestString().empty() && !client.hasPipelinedBytes())
+		return Client::Phase::IDLE;
+	return Client::Phase::HEADERS;
+}
+
+/**
+ * Sets the deadline of the phase the client is in, a phase change restarts
+ * the phase clock. Deadlines between reads and writes move with every
+ * transfer, so the wheel gets a new timer only when the deadline came closer.
+ * A deadline which moved away is picked up when the earlier timer fires
+ */
+void ServersManager::updateDeadline(Server& server, Client& client)
+{
+	auto now = std::chrono::steady_clock::now();
+	Client::Phase phase = findPhase(client);
+
+	if (phase != client.getPhase())
+	{
+		client.setPhase(phase);
+		client.setPhaseStart(now);
+	}
+
+	const ServerConfig& config = *server.findServerConfig(client.getRequest());
+	auto lastTransfer = std::max(client.getPhaseStart(), client.getLastActivity());
+	auto deadline = std::chrono::steady_clock::time_point::max();
+	switch (phase)
+	{
+		case Client::Phase::IDLE:
+			deadline = client.getPhaseStart() + std::chrono::seconds(client.getKeepAliveTimeout());
+			break ;
+		case Client::Phase::HEADERS:
+			deadline = client.getPhaseStart() + std::chrono::seconds(config.headerTimeout);
+			break ;
+		case Client::Phase::BODY:
+			deadline = lastTransfer + std::chrono::seconds(config.bodyTimeout);
+			// Every byte received buys 1 / bodyMinRate seconds on top of one bodyTimeout
+			if (config.bodyMinRate > 0)
+				deadline = std::min(deadline, client.getPhaseStart() + std::chrono::seconds(config.bodyTimeout)
+					+ std::chrono::milliseconds((client.getRequestString().size() + client.getParser().getBodyBytes())
+					* 1000 / config.bodyMinRate));
+			break ;
+		case Client::Phase::CGI:
+			deadline = client.getCgiStart() + std::chrono::seconds(config.cgiTimeout);
+			break ;
+		case Client::Phase::WRITE:
+			deadline = lastTransfer + std::chrono::seconds(config.sendTimeout);
+			break ;
+		default:
+			break ;
+	}
+	client.setDeadline(deadline);
+	if (deadline < client.getTimerAt())
+	{
+		_timers.schedule(&server, client.getHandle(), deadline);
+		client.setTimerAt(deadline);
+	}
+}
+
+/* Timers of closed clients and timers replaced by an earlier one are skipped */
+void ServersManager::expireTimers(std::chrono::steady_clock::time_point now)
+{
+	for (TimerWheel::Timer& timer : _timers.advance(now))
+	{
+		Client* client = timer.server->getClient(timer.client);
+		if (!client || client->getTimerAt() != timer.at)
+			continue ;
+		client->setTimerAt(std::chrono::steady_clock::time_point::max());
+		if (client->getDeadline() <= now)
 		{
-			if (errno == EINTR)
-				continue ;
-			else
-				throw ServerException("poll() error");
+			handleTimeout(*timer.server, *client);
+			continue ;
+		}
+		if (client->getDeadline() != std::chrono::steady_clock::time_point::max())
+		{
+			_timers.schedule(timer.server, timer.client, client->getDeadline());
+			client->setTimerAt(client->getDeadline());
 		}
-		checkRevents(new_fds);
-		if (!new_fds.empty())
-			_fds.insert(_fds.end(), new_fds.begin(), new_fds.end());
 	}
 }
 
-void ServersManager::handleRead(int fdReadyForRead, std::vector<pollfd>& new_fds)
+/* A script which ran too long is answered with 504, in any other phase the connection is closed */
+void ServersManager::handleTimeout(Server& server, Client& client)
 {
-	bool fdFound = false;
+	static const char* phaseNames[] = {"", "Keep-alive", "Headers", "Body", "CGI", "Send"};
 
-	for (std::shared_ptr<Server>& server : _servers)
+	LOG_INFO(phaseNames[static_cast<int>(client.getPhase())], " timeout on socket fd: ", client.getFd());
+	if (client.getPhase() == Client::Phase::CGI)
+	{
+		server.handleCGITimeout(client);
+		_eventLoop->modify(client.getFd(), POLLOUT);
+		updateDeadline(server, client);
+		return ;
+	}
+	server.finalizeResponse(client);
+}
+
+/**
+ * Drains the listener backlog, at most _acceptBatchSize connections per tick so
+ * a burst does not starve the clients already connected. The rest of the
+ * backlog is taken on the next tick
+ */
+void ServersManager::acceptClients(Server& server)
+{
+	for (int accepted = 0; accepted < _acceptBatchSize; accepted++)
 	{
-		if (fdReadyForRead == server->getServerSockfd())
+		Client* client = server.accepter();
+		if (client)
 		{
-			int clientSockfd = server->accepter();
-			new_fds.push_back({clientSockfd, POLLIN | POLLOUT | POLLERR | POLLHUP, 0}); 
-			break ;
+			server.watchFd(client->getFd(), POLLIN, FdTable::FdRole::CLIENT, client->getHandle());
+			updateDeadline(server, *client);
+			continue ;
 		}
-		for (Client& client : server->getClients())
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return ;
+		if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
 		{
-			if (fdReadyForRead == client.getFd()
-				&& client.getState() == Client::ClientState::READING)
-			{
-				if (!server->handler(server, client))
-					changeStateToDeleteClient(client);
-				if (client.getState() == Client::ClientState::READY_TO_WRITE
-					&& client.getRequest()->getStartLine()["path"].rfind("/cgi-bin/") == 0)
-						CGIHandler::InitCGI(client, new_fds);
-				fdFound = true;
-				break ;
-			}
-			if (ifCGIsFd(client, fdReadyForRead) && client.getCGIState() == Client::CGIState::FORKED)
-			{
-				LOG_DEBUG("Now forked and reading");
-				try
-				{
-					if (CGIHandler::readScriptOutput(client, server)) // read in CGI
-						CGIHandler::changeToErrorState(client);
-				}
-				catch (ProcessingError& e)
-				{
-					changeStateToDeleteClient(client);
-				}
-				fdFound = true;
-				break ;
-			}
+			LOG_WARNING("accept() error: ", strerror(errno), ", accepting paused for ", _acceptRetryMs, " ms");
+			pauseAccepting();
+			return ;
 		}
-		if (fdFound)
+		// The connection was reset while waiting in the backlog, the next one can still be accepted
+		if (errno == ECONNABORTED || errno == EPROTO || errno == EINTR)
+			continue ;
+		LOG_ERROR("accept() error on socket fd ", server.getServerSockfd(), ": ", strerror(errno));
+		return ;
+	}
+	// An edge-triggered listener is not reported again for the connections left in the backlog
+	_eventLoop->rearm(server.getServerSockfd(), POLLIN);
+}
+
+/**
+ * Out of fds, accepting again right away would only spin. Listeners stop being
+ * watched, pending connections wait in the backlog until some clients are closed
+ */
+void ServersManager::pauseAccepting()
+{
+	for (std::shared_ptr<Server>& server : _servers)
+		_eventLoop->modify(server->getServerSockfd(), 0);
+	_acceptPaused = true;
+	_acceptPausedAt = std::chrono::steady_clock::now();
+}
+
+void ServersManager::resumeAccepting()
+{
+	for (std::shared_ptr<Server>& server : _servers)
+		_eventLoop->modify(server->getServerSockfd(), POLLIN);
+	_acceptPaused = false;
+	LOG_DEBUG("Accepting resumed");
+}
+
+void ServersManager::readFromClient(Server& server, Client& client)
+{
+	if (!server.handler(client))
+		changeStateToDeleteClient(client);
+	if (client.getState() == Client::ClientState::READY_TO_WRITE
+		&& client.getRequest()->getStartLine()["path"].rfind("/cgi-bin/") == 0)
+			CGIHandler::InitCGI(client, server);
+	// The rest of the client cycle is driven by write readiness
+	if (client.getState() != Client::ClientState::READING)
+		_eventLoop->modify(client.getFd(), POLLOUT);
+	else if (!client.getWouldBlock())
+		_eventLoop->rearm(client.getFd(), POLLIN);
+	updateDeadline(server, client);
+}
+
+void ServersManager::readFromCGI(Server& server, Client& client)
+{
+	LOG_DEBUG("Now forked and reading");
+	try
+	{
+		if (CGIHandler::readScriptOutput(client, server)) // read in CGI
+			CGIHandler::changeToErrorState(client);
+	}
+	catch (ProcessingError& e)
+	{
+		changeStateToDeleteClient(client);
+	}
+	// The script is done, the socket is watched again to send the response
+	if (client.getCGIState() != Client::CGIState::FORKED)
+	{
+		_eventLoop->modify(client.getFd(), POLLOUT);
+		updateDeadline(server, client);
+	}
+}
+
+/* The fd table gives the owner of the fd directly, fds which are not in the table anymore are ignored */
+void ServersManager::handleRead(int fdReadyForRead)
+{
+	const FdTable::Entry& entry = _fdTable->get(fdReadyForRead);
+	Client* client = nullptr;
+
+	switch (entry.role)
+	{
+		case FdTable::FdRole::LISTENER:
+			acceptClients(*entry.server);
+			break ;
+		case FdTable::FdRole::CLIENT:
+			client = entry.server->getClient(entry.client);
+			if (client && client->getState() == Client::ClientState::READING)
+				readFromClient(*entry.server, *client);
+			break ;
+		case FdTable::FdRole::CGI_STDOUT:
+			client = entry.server->getClient(entry.client);
+			if (client && client->getCGIState() == Client::CGIState::FORKED)
+				readFromCGI(*entry.server, *client);
+			break ;
+		case FdTable::FdRole::FILE_CACHE:
+			FileCache::handleEvents();
+			break ;
+		default:
 			break ;
 	}
 }
 
-void ServersManager::processClientCycle(std::shared_ptr<Server>& server, Client& client, int fdReadyForWrite)
+void ServersManager::processClientCycle(Server& server, Client& client, int fdReadyForWrite)
 {
 	if (client.getState() == Client::ClientState::READY_TO_WRITE && !ifCGIsFd(client, fdReadyForWrite))
 	{
-		server->responder(client, *server);
+		server.responder(client, server);
 		if (client.getChildPipe(0) == -1)
 		{
 			client.setState(Client::ClientState::BUILDING);
@@ -241,8 +490,10 @@ void ServersManager::processClientCycle(std::shared_ptr<Server>& server, Client&
 		|| (ifCGIsFd(client, fdReadyForWrite) && client.getCGIState() == Client::CGIState::FINISHED_SET))
 	{
 		SessionsManager::handleSessions(client);
-		client.setResponseString(Response::buildResponse(*client.getResponse()));
-		LOG_DEBUG("response: ", client.getResponseString().substr(0, 500), "\n...\n");
+		client.setKeepAlive(server.isKeepAlive(client));
+		Response::buildResponse(*client.getResponse(), client.getOutput(), client.getKeepAlive());
+		batchPipelinedResponses(server, client);
+		LOG_DEBUG("response queued, bytes: ", client.getOutput().size());
 		client.setState(Client::ClientState::WRITING);
 	}
 	if (fdReadyForWrite == client.getFd() && client.getState() == Client::ClientState::WRITING)
@@ -250,89 +501,118 @@ void ServersManager::processClientCycle(std::shared_ptr<Server>& server, Client&
 		LOG_DEBUG("Sending the response now");
 		try
 		{
-			if (server->sendResponse(client))
+			if (server.sendResponse(client))
 				client.setState(Client::ClientState::FINISHED_WRITING);
 		}
 		catch (ProcessingError& e)
 		{
 			client.setState(Client::ClientState::FINISHED_WRITING);
+			client.setKeepAlive(false);
 		}
 		
 	}
+	if (client.getState() == Client::ClientState::FINISHED_WRITING
+		&& (client.getChildPipe(0) == -1 || client.getCGIState() == Client::CGIState::FINISHED_SET)
+		&& client.getKeepAlive())
+	{
+		keepClientAlive(server, client);
+		return ;
+	}
 	if (client.getState() == Client::ClientState::FINISHED_WRITING
 		&& (client.getChildPipe(0) == -1 || client.getCGIState() == Client::CGIState::FINISHED_SET))
 	{
 		LOG_INFO("Socket fd: ", client.getFd(), " will be closed");
-		server->finalizeResponse(client);
+		server.finalizeResponse(client);
 		LOG_INFO("Connection closed");
+		return ;
 	}
+	// A writable socket would wake the loop on every tick while the script runs,
+	// it is not watched until readFromCGI() or the CGI timeout finish the script
+	if (client.getCGIState() == Client::CGIState::FORKED)
+		_eventLoop->modify(client.getFd(), 0);
+	// In edge-triggered mode the states before WRITING do no I/O, so the next step needs a rearm
+	else if (fdReadyForWrite == client.getFd() && !client.getWouldBlock())
+		_eventLoop->rearm(client.getFd(), POLLOUT);
+	updateDeadline(server, client);
 }
 
-void ServersManager::handleWrite(int fdReadyForWrite)
+/**
+ * Pipelined requests which are already in the buffer and can be answered right
+ * away get their responses appended to the client's output chain, so they
+ * leave in the same writev(). Each request is parsed on a scratch client which
+ * borrows the kept bytes. A request which did not arrive whole leaves its parser
+ * state on the client for the normal cycle, one which needs a CGI or fails is
+ * given back to the kept bytes and goes through the normal cycle after the batch
+ */
+void ServersManager::batchPipelinedResponses(Server& server, Client& client)
 {
-	bool fdFound = false;
+	OutputChain& batch = client.getOutput();
 
-	for (std::shared_ptr<Server>& server : _servers)
+	while (client.getKeepAlive() && client.hasPipelinedBytes() && batch.size() < g_bufferSize)
 	{
-		for (Client& client : server->getClients())
-		{
-			if (fdReadyForWrite == client.getFd() || (ifCGIsFd(client, fdReadyForWrite)))
-			{
-				processClientCycle(server, client, fdReadyForWrite);
-				fdFound = true;
-				break ;
-			}
-		}
-		if (fdFound)
-			break ;
-	}
-}
+		Client next;
+		next.setFd(client.getFd());
+		client.movePipelinedBytesTo(next);
+		next.setRequestsServed(client.getRequestsServed() + 1);
+		next.setKeepAliveTimeout(client.getKeepAliveTimeout());
 
-void ServersManager::removeFromPollfd(int fd)
-{
-	for (auto fd_it = _fds.begin(); fd_it != _fds.end(); ++fd_it)
-	{
-		if (fd_it->fd == fd)
+		size_t requestStart = next.getPipelinedOffset();
+		bool handled = server.handler(next);
+		if (!handled || next.getState() != Client::ClientState::READY_TO_WRITE
+			|| next.getRequest()->getStartLine()["path"].rfind("/cgi-bin/", 0) == 0)
 		{
-			_fds.erase(fd_it);
+			if (handled && next.getState() == Client::ClientState::READING)
+				client.keepPendingRequest(next);
+			else
+				next.setPipelinedOffset(requestStart);
+			next.movePipelinedBytesTo(client);
 			break ;
 		}
+
+		server.responder(next, server);
+		SessionsManager::handleSessions(next);
+		next.setKeepAlive(server.isKeepAlive(next));
+		Response::buildResponse(*next.getResponse(), batch, next.getKeepAlive());
+		LOG_DEBUG("Pipelined response batched, batch length: ", batch.size());
+
+		next.movePipelinedBytesTo(client);
+		client.setRequestsServed(next.getRequestsServed());
+		client.setKeepAlive(next.getKeepAlive());
 	}
 }
 
-void ServersManager::removeClientByFd(int currentFd)
+/* The socket goes back to waiting for a request, a request already in the buffer is handled right away */
+void ServersManager::keepClientAlive(Server& server, Client& client)
 {
-	for (std::shared_ptr<Server>& server : _servers)
-	{
-		std::vector<Client>& clients = server->getClients();
-		for (auto it = clients.begin(); it != clients.end(); ++it)
-		{
-			if (it->getFd() == currentFd)
-			{
-				clients.erase(it);
-				break ;
-			}
-		}
-	}
+	LOG_INFO("Socket fd: ", client.getFd(), " kept alive for the next request");
+	server.resetClient(client);
+	_eventLoop->modify(client.getFd(), POLLIN);
+	if (client.hasPipelinedBytes())
+		readFromClient(server, client);
+	else
+		updateDeadline(server, client);
 }
 
-bool ServersManager::ifCGIsFd(Client& client, int fd)
+/* The request body is written to the CGI stdin right after fork, so only client sockets are handled here */
+void ServersManager::handleWrite(int fdReadyForWrite)
 {
-	return fd == client.getChildPipe(0);
+	const FdTable::Entry& entry = _fdTable->get(fdReadyForWrite);
+
+	if (entry.role != FdTable::FdRole::CLIENT)
+		return ;
+	Client* client = entry.server->getClient(entry.client);
+	if (client)
+		processClientCycle(*entry.server, *client, fdReadyForWrite);
 }
 
-pollfd* ServersManager::findPollfdByFd(int fd)
+bool ServersManager::ifCGIsFd(Client& client, int fd)
 {
-	for (struct pollfd& pfd : _fds)
-	{
-		if (pfd.fd == fd)
-			return &pfd;
-	}
-	return nullptr;
+	return fd == client.getChildPipe(0);
 }
 
 void ServersManager::changeStateToDeleteClient(Client& client)
 {
+	client.setKeepAlive(false);
 	client.setState(Client::ClientState::FINISHED_WRITING);
 	client.setCGIState(Client::CGIState::FINISHED_SET);
 }
@@ -6,7 +6,7 @@
 /*   By: ixu <ixu@student.hive.fi>                  +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:10:53 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/12 11:17:56 by ixu              ###   ########.fr       */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -15,13 +15,18 @@
 #include "Server.hpp"
 #include "../config/Config.hpp"
 #include "../response/Response.hpp"
+#include "../response/FileCache.hpp"
 #include "../utils/logUtils.hpp"
 #include "CGIHandler.hpp"
+#include "EventLoop.hpp"
+#include "FdTable.hpp"
+#include "TimerWheel.hpp"
 #include <vector>
 #include <poll.h>
 #include <csignal>
 #include <string>
 #include <errno.h>
+#include <chrono>
 
 #include <exception>
 #include "../utils/globals.hpp"
@@ -30,38 +35,60 @@
 
 class Server;
 
-/* Can be only instatiated once */
+/**
+ * One manager per event loop thread. A manager owns its servers (listeners
+ * bound with SO_REUSEPORT when there are several loops), clients, event loop
+ * and fd table, nothing of it is touched by other threads. Only the parsed
+ * config is shared and it is read-only
+ */
 class ServersManager
 {
 	private:
-		static std::shared_ptr<ServersManager>		_instance;
-		static std::vector<std::shared_ptr<Server>>	_servers;
-		static std::shared_ptr<Config>				_webservConfig;
-		static std::vector<struct pollfd>			_fds;
+		static std::shared_ptr<const Config>		_webservConfig;
+		std::vector<std::shared_ptr<Server>>		_servers;
+		std::shared_ptr<EventLoop>					_eventLoop;
+		std::shared_ptr<FdTable>					_fdTable;
+		TimerWheel									_timers;
+		static constexpr int						_maxWaitMs = 1000; // the stop flag is checked at least this often
+		static constexpr int						_acceptBatchSize = 64; // connections accepted per listener per tick
+		static constexpr int						_acceptRetryMs = 100; // pause after running out of fds
+		bool										_acceptPaused = false;
+		std::chrono::steady_clock::time_point		_acceptPausedAt;
 
 		void										processFoundServer(std::shared_ptr<Server> foundServer, std::vector<ServerConfig> serverConfigs);
 		std::shared_ptr<Server>						findNoIpServerByPort(int port);
+		bool										isPortTaken(int port);
 		bool										checkUniqueNameServer(ServerConfig& serverConfig, std::vector<ServerConfig>& targetServerconfigs);
 		void										moveServerConfigsToNoIpServer(int port, std::vector<ServerConfig>& serverConfigs);
-		void										handleRead(int fdReadyForRead, std::vector<pollfd>& new_fds);
-		void										processClientCycle(std::shared_ptr<Server>& server, Client& client, int fdReadyForWrite);
+		void										handleRead(int fdReadyForRead);
+		void										acceptClients(Server& server);
+		void										pauseAccepting();
+		void										resumeAccepting();
+		void										readFromClient(Server& server, Client& client);
+		void										readFromCGI(Server& server, Client& client);
+		void										processClientCycle(Server& server, Client& client, int fdReadyForWrite);
+		void										batchPipelinedResponses(Server& server, Client& client);
+		void										keepClientAlive(Server& server, Client& client);
+		void										updateDeadline(Server& server, Client& client);
+		void										expireTimers(std::chrono::steady_clock::time_point now);
+		void										handleTimeout(Server& server, Client& client);
+		static Client::Phase						findPhase(Client& client);
 		void										handleWrite(int fdReadyForWrite);
-		void										removeClientByFd(int fd);
 		bool										ifCGIsFd(Client& client, int fd);
-		pollfd*										findPollfdByFd(int fd);
-		static void									printServersInfo();
-		void										checkRevents(std::vector<pollfd>& new_fds);
+		void										printServersInfo();
+		void										killScripts();
+		void										watchFileCache();
+		void										checkRevents(std::vector<pollfd>& readyFds);
 
-		ServersManager();
 		ServersManager(const ServersManager&) = delete;
 		ServersManager& operator=(const ServersManager&) = delete;
 
 	public:
+		ServersManager();
 		~ServersManager();
-		static std::shared_ptr<ServersManager>		getInstance(const char* argv0);
 
 		void										run();
 		static void									initConfig(const char *fileNameString, const char* argv0);
-		static void									removeFromPollfd(int fd);
+		static const MainConfig&					getMainConfig();
 		static void									changeStateToDeleteClient(Client& client);
 };
@@ -6,14 +6,14 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/12 15:02:01 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/05 13:21:57 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/08/21 16:12:40 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "SessionsManager.hpp"
 
 const std::string SessionsManager::_filename = "sessions";
-std::string SessionsManager::_session;
+std::mutex SessionsManager::_fileMutex;
 static const std::vector<std::string> mediaExtensions =
 {
 	".jpg",
@@ -46,20 +46,21 @@ void SessionsManager::handleSessions(Client& client)
 {
 	std::string cookie = client.getRequest()->getHeaders()["cookie"];
 
+	std::lock_guard<std::mutex> lock(_fileMutex);
 	checkPermissions();
 	if (isHTMLRequest(client))
 	{
 		if ((cookie.empty() || !sessionExistsCheck(cookie))
 			&& client.getResponse()->getHeader("Set-Cookie").empty())
 		{
-			generateSession(client.getRequest());
-			addSessionToFile(getSession());
-			setSessionToResponse(client.getResponse(), getSession());
+			std::string session = generateSession(client.getRequest());
+			addSessionToFile(session);
+			setSessionToResponse(client.getResponse(), session);
 		}
 	}
 }
 
-void SessionsManager::generateSession(std::shared_ptr<Request> request)
+std::string SessionsManager::generateSession(std::shared_ptr<Request> request)
 {
 	auto now = std::chrono::system_clock::now();
 	auto duration = now.time_since_epoch();
@@ -93,13 +94,15 @@ void SessionsManager::generateSession(std::shared_ptr<Request> request)
 	auto expirationTime = std::chrono::system_clock::now() + std::chrono::hours(24 * 365);
 	std::time_t expirationTimeT = std::chrono::system_clock::to_time_t(expirationTime);
 	char expirationBuffer[100];
-	std::strftime(expirationBuffer, sizeof(expirationBuffer), "%a, %d-%b-%Y %H:%M:%S GMT", std::gmtime(&expirationTimeT));
+	std::tm expirationTm;
+	gmtime_r(&expirationTimeT, &expirationTm);
+	std::strftime(expirationBuffer, sizeof(expirationBuffer), "%a, %d-%b-%Y %H:%M:%S GMT", &expirationTm);
 	
 	sessionStream << expirationBuffer <<"; path=/";
 	sessionStream <<"; host=";
 	sessionStream << request->getHeaders()["host"];
 
-	setSession(sessionStream.str());
+	return sessionStream.str();
 }
 
 void SessionsManager::checkPermissions()
@@ -208,16 +211,6 @@ bool SessionsManager::isHTMLRequest(Client& client)
 	return true;
 }
 
-void SessionsManager::setSession(std::string session)
-{
-	_session = session;
-}
-
-std::string& SessionsManager::getSession()
-{
-	return _session;
-}
-
 const std::string SessionsManager::getFilename()
 {
 	return _filename;
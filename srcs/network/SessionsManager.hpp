@@ -6,7 +6,7 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/12 12:23:32 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/05 13:23:29 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/08/21 16:12:40 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -14,6 +14,7 @@
 
 #include <random>
 #include <chrono>
+#include <mutex>
 
 #include "Client.hpp"
 #include "../utils/Utility.hpp"
@@ -21,12 +22,12 @@
 
 class SessionsManager {
 	private:
-		static std::string			_session;
 		const static std::string	_filename;
 		const static size_t			_MAX_SESSIONS = 500;
+		static std::mutex			_fileMutex; // the sessions file is shared by the event loop threads
 		
 		static bool					sessionExistsCheck(std::string& sessionData);
-		static void					generateSession(std::shared_ptr<Request> request);
+		static std::string			generateSession(std::shared_ptr<Request> request);
 		static void					addSessionToFile(std::string& sessionData);
 		static void					manageSessions(std::deque<std::string>& sessions);
 		static void					setSessionToResponse(std::shared_ptr<Response> response, std::string& sessionData);
@@ -34,8 +35,6 @@ class SessionsManager {
 		static void					checkPermissions();
 		
 	public:
-		static void					setSession(std::string session);
-		static std::string&			getSession();
 		const std::string			getFilename();
 		
 		static void					handleSessions(Client& client);
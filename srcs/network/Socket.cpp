@@ -6,7 +6,7 @@
 /*   By: ixu <ixu@student.hive.fi>                  +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/06/19 11:09:46 by ixu               #+#    #+#             */
-/*   Updated: 2024/08/09 17:31:34 by ixu              ###   ########.fr       */
+/*   Updated: 2024/10/03 15:36:11 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -29,7 +29,8 @@ void Socket::create()
 {
 	LOG_DEBUG("Socket::create() called");
 
-	_sockfd = socket(AF_INET, SOCK_STREAM, 0);
+	// close-on-exec keeps listeners and clients out of CGI scripts
+	_sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
 	if (!isValidSocketFd())
 	{
 		closeSocketFd("socket() error: ");
@@ -37,7 +38,7 @@ void Socket::create()
 	}
 }
 
-void Socket::bindAddress(struct addrinfo* res)
+void Socket::bindAddress(struct addrinfo* res, bool reusePort)
 {
 	LOG_DEBUG("Socket::bindAddress() called");
 
@@ -53,19 +54,18 @@ void Socket::bindAddress(struct addrinfo* res)
 		throw ServerException("Failed to set socket options: " + std::string(strerror(errno)));
 	}
 
-	// set socket to non-blocking mode
-	int flags = fcntl(_sockfd, F_GETFL, 0);
-	if (flags < 0)
+	// each worker binds its own listener to the same port, the kernel balances connections between them
+	if (reusePort && setsockopt(_sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
 	{
-		closeSocketFd("fcntl F_GETFL error: ");
-		throw ServerException("fcntl F_GETFL error: " + std::string(strerror(errno)));
+		closeSocketFd("setsockopt() error: ");
+		throw ServerException("Failed to set SO_REUSEPORT: " + std::string(strerror(errno)));
 	}
 
-	ret = fcntl(_sockfd, F_SETFL, flags | O_NONBLOCK);
-	if (ret < 0)
+	// set socket to non-blocking mode
+	if (!setNonBlocking(_sockfd))
 	{
-		closeSocketFd("fcntl F_SETFL error: ");
-		throw ServerException("fcntl F_SETFL error: " + std::string(strerror(errno)));
+		closeSocketFd("fcntl() error: ");
+		throw ServerException("fcntl() error: " + std::string(strerror(errno)));
 	}
 
 	ret = bind(_sockfd, res->ai_addr, res->ai_addrlen);
@@ -77,6 +77,34 @@ void Socket::bindAddress(struct addrinfo* res)
 	}	
 }
 
+/**
+ * Applied between bind() and listen(): buffer sizes are inherited by accepted
+ * sockets and the window scale is negotiated from them. An option the kernel
+ * refuses is only logged, the listener works with the kernel default then
+ */
+void Socket::setListenerOptions(const SocketOptions& options)
+{
+	LOG_DEBUG("Socket::setListenerOptions() called");
+
+	if (!isValidSocketFd())
+		throw ServerException("Not a valid socket fd while setting options");
+
+	if (options.sendBufferSize > 0)
+		setIntOption(_sockfd, SOL_SOCKET, SO_SNDBUF, options.sendBufferSize, "SO_SNDBUF");
+	if (options.receiveBufferSize > 0)
+		setIntOption(_sockfd, SOL_SOCKET, SO_RCVBUF, options.receiveBufferSize, "SO_RCVBUF");
+	if (options.tcpDeferAccept > 0)
+		setIntOption(_sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options.tcpDeferAccept, "TCP_DEFER_ACCEPT");
+	if (options.tcpFastOpen > 0)
+		setIntOption(_sockfd, IPPROTO_TCP, TCP_FASTOPEN, options.tcpFastOpen, "TCP_FASTOPEN");
+
+	// The kernel doubles buffer sizes and rounds the defer timeout, so the values in use are read back
+	LOG_INFO("Listener (socket fd: ", _sockfd, ") options: SO_SNDBUF ", getIntOption(_sockfd, SOL_SOCKET, SO_SNDBUF),
+		", SO_RCVBUF ", getIntOption(_sockfd, SOL_SOCKET, SO_RCVBUF),
+		", TCP_DEFER_ACCEPT ", getIntOption(_sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT),
+		", TCP_FASTOPEN ", getIntOption(_sockfd, IPPROTO_TCP, TCP_FASTOPEN));
+}
+
 void Socket::listenForConnections(int backlog)
 {
 	LOG_DEBUG("Socket::listenForConnections() called");
@@ -90,25 +118,59 @@ void Socket::listenForConnections(int backlog)
 		closeSocketFd("listen() error: ");
 		throw ServerException("could not start listening for connections: " + std::string(strerror(errno)));
 	}
+
+	// listen() silently caps the backlog at net.core.somaxconn
+	std::ifstream somaxconnFile("/proc/sys/net/core/somaxconn");
+	int somaxconn = 0;
+	if (somaxconnFile >> somaxconn && somaxconn < backlog)
+	{
+		LOG_WARNING("Listen backlog ", backlog, " is capped by net.core.somaxconn to ", somaxconn);
+		return ;
+	}
+	LOG_INFO("Listener (socket fd: ", _sockfd, ") backlog: ", backlog);
 }
 
-int Socket::acceptConnection(struct sockaddr_in addr)
+bool Socket::setNonBlocking(int fd)
 {
-	LOG_DEBUG("Socket::acceptConnection() called");
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0)
+		return false;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
 
-	if (!isValidSocketFd())
-		throw ServerException("Not a valid socket fd while accepting");
+/* Options which are not inherited from the listener, set right after accept */
+void Socket::setClientOptions(int fd, const SocketOptions& options)
+{
+	if (options.tcpNoDelay)
+		setIntOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+}
+
+/* A corked socket sends only full segments, uncorking flushes the rest of the response */
+void Socket::setCork(int fd, bool cork)
+{
+	setIntOption(fd, IPPROTO_TCP, TCP_CORK, cork ? 1 : 0, "TCP_CORK");
+}
 
-	socklen_t addrlen = sizeof(addr);
-	int acceptedSocketFd = accept(_sockfd, (struct sockaddr*)&addr, &addrlen);
-	LOG_INFO("new client socket fd is: ", acceptedSocketFd);
-	if (acceptedSocketFd < 0)
+bool Socket::setIntOption(int fd, int level, int option, int value, const char* name)
+{
+	if (setsockopt(fd, level, option, &value, sizeof(value)) < 0)
 	{
-		closeSocketFd("accept() error: ");
-		throw ServerException("could not start accepting connections: " + std::string(strerror(errno)));
+		LOG_WARNING("setsockopt() ", name, " on socket fd ", fd, " refused: ", strerror(errno));
+		return false;
 	}
-	
-	return acceptedSocketFd;
+	LOG_DEBUG("setsockopt() ", name, " set to ", value, " on socket fd ", fd);
+	return true;
+}
+
+/* Returns -1 when the option can not be read */
+int Socket::getIntOption(int fd, int level, int option)
+{
+	int value = 0;
+	socklen_t length = sizeof(value);
+
+	if (getsockopt(fd, level, option, &value, &length) < 0)
+		return -1;
+	return value;
 }
 
 int Socket::getSockfd()
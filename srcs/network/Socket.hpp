@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/06/19 11:09:53 by ixu               #+#    #+#             */
-/*   Updated: 2024/08/02 14:01:57 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/10/03 15:36:11 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -21,6 +21,8 @@
 #include <unistd.h> // close()
 #include <fcntl.h> // fcntl()
 #include <arpa/inet.h> // inet_ntoa()
+#include <netinet/tcp.h> // TCP_NODELAY, TCP_CORK, TCP_DEFER_ACCEPT, TCP_FASTOPEN
+#include <fstream> // net.core.somaxconn
 
 
 #include <sys/types.h>
@@ -28,6 +30,7 @@
 #include <netdb.h>
 
 #include "../utils/ServerException.hpp"
+#include "../config/Config.hpp"
 
 class Socket
 {
@@ -40,11 +43,17 @@ class Socket
 
 		int		getSockfd();
 		void	create();
-		void	bindAddress(struct addrinfo* res);
+		void	bindAddress(struct addrinfo* res, bool reusePort = false);
+		void	setListenerOptions(const SocketOptions& options);
 		void	listenForConnections(int backlog);
-		int		acceptConnection(struct sockaddr_in addr);
+
+		static bool	setNonBlocking(int fd);
+		static void	setClientOptions(int fd, const SocketOptions& options);
+		static void	setCork(int fd, bool cork);
 
 	private:
-		bool	isValidSocketFd();
-		void	closeSocketFd(const std::string& msg);
+		bool		isValidSocketFd();
+		void		closeSocketFd(const std::string& msg);
+		static bool	setIntOption(int fd, int level, int option, int value, const char* name);
+		static int	getIntOption(int fd, int level, int option);
 };
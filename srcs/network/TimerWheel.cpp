@@ -0,0 +1,106 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerWheel.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/28 15:06:44 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/28 15:06:44 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#include "TimerWheel.hpp"
+
+TimerWheel::TimerWheel() : _start(Clock::now()), _currentTick(0), _count(0) {}
+
+/* Rounded up, a timer never fires before its deadline */
+uint64_t TimerWheel::toTick(Clock::time_point at) const
+{
+	if (at <= _start)
+		return 0;
+	return (at - _start + _tick - Clock::duration(1)) / _tick;
+}
+
+/* The level is chosen by the distance to the deadline, the slot by the deadline itself */
+void TimerWheel::insert(const Timer& timer, uint64_t tick)
+{
+	uint64_t distance = tick - _currentTick;
+	int level = 0;
+
+	while (level < _levels - 1 && distance >= (_slots << (_slotBits * level)))
+		level++;
+	// Deadlines past the last level wait in its farthest slot and are cascaded again
+	if (distance >= (_slots << (_slotBits * level)))
+		tick = _currentTick + (_slots << (_slotBits * level)) - 1;
+	_wheel[level][(tick >> (_slotBits * level)) & (_slots - 1)].push_back(timer);
+}
+
+void TimerWheel::schedule(Server* server, ClientHandle client, Clock::time_point at)
+{
+	// The current slot has already been expired, so the earliest tick is the next one
+	insert({server, client, at}, std::max(toTick(at), _currentTick + 1));
+	_count++;
+}
+
+/* Called when level 0 wraps, moves the next slot of every upper level one level down */
+void TimerWheel::cascade()
+{
+	for (int level = 1; level < _levels; level++)
+	{
+		uint64_t slot = (_currentTick >> (_slotBits * level)) & (_slots - 1);
+		std::vector<Timer> timers;
+		timers.swap(_wheel[level][slot]);
+		for (const Timer& timer : timers)
+			insert(timer, std::max(toTick(timer.at), _currentTick));
+		if (slot != 0)
+			break ;
+	}
+}
+
+/**
+ * Returns the timers whose tick has passed. The vector is reused by the next
+ * call, timers scheduled while it is walked go to the wheel
+ */
+std::vector<TimerWheel::Timer>& TimerWheel::advance(Clock::time_point now)
+{
+	uint64_t target = (now - _start) / _tick;
+
+	_expired.clear();
+	if (_count == 0 && target > _currentTick)
+		_currentTick = target;
+	while (_currentTick < target)
+	{
+		_currentTick++;
+		if ((_currentTick & (_slots - 1)) == 0)
+			cascade();
+		std::vector<Timer>& slot = _wheel[0][_currentTick & (_slots - 1)];
+		_expired.insert(_expired.end(), slot.begin(), slot.end());
+		slot.clear();
+	}
+	_count -= _expired.size();
+	return _expired;
+}
+
+/**
+ * Time the event loop can sleep. Only level 0 is searched, when it is empty
+ * the loop wakes up at its wrap to cascade the next level
+ */
+int TimerWheel::msUntilNext(Clock::time_point now, int maxMs) const
+{
+	if (_count == 0)
+		return maxMs;
+	uint64_t ticks = _slots - (_currentTick & (_slots - 1));
+	for (uint64_t i = 1; i <= _slots; i++)
+	{
+		if (!_wheel[0][(_currentTick + i) & (_slots - 1)].empty())
+		{
+			ticks = i;
+			break ;
+		}
+	}
+	auto wakeUp = _start + (_currentTick + ticks) * _tick;
+	if (wakeUp <= now)
+		return 0;
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wakeUp - now).count() + 1;
+	return ms < maxMs ? static_cast<int>(ms) : maxMs;
+}
@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerWheel.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/28 15:06:44 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/08/28 15:06:44 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#pragma once
+
+#include "Client.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class Server;
+
+/**
+ * Hierarchical timer wheel of client deadlines, one per event loop. Level 0
+ * has a slot per tick, every next level a slot per full turn of the level
+ * below, whose timers are cascaded down when the lower level wraps. Adding a
+ * timer and expiring one is O(1) whatever the number of connections.
+ * Timers are not removed when a deadline changes: the owner compares the
+ * time of an expired timer with the one it scheduled last and skips stale ones
+ */
+class TimerWheel
+{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct Timer
+		{
+			Server*				server;
+			ClientHandle		client;
+			Clock::time_point	at;
+		};
+
+	private:
+		static constexpr int							_levels = 4;
+		static constexpr int							_slotBits = 6;
+		static constexpr uint64_t						_slots = 1 << _slotBits;
+		static constexpr std::chrono::milliseconds		_tick{10};
+
+		std::array<std::array<std::vector<Timer>, _slots>, _levels>	_wheel;
+		std::vector<Timer>								_expired;
+		Clock::time_point								_start;
+		uint64_t										_currentTick;
+		size_t											_count;
+
+		uint64_t										toTick(Clock::time_point at) const;
+		void											insert(const Timer& timer, uint64_t tick);
+		void											cascade();
+
+	public:
+		TimerWheel();
+
+		void											schedule(Server* server, ClientHandle client, Clock::time_point at);
+		std::vector<Timer>&								advance(Clock::time_point now);
+		int												msUntilNext(Clock::time_point now, int maxMs) const;
+};
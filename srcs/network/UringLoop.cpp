@@ -0,0 +1,566 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UringLoop.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/30 17:25:09 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/04 11:20:05 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#include "UringLoop.hpp"
+
+/* Throws when the kernel has no io_uring or does not allow it, EventLoop::create() falls back to epoll then */
+UringLoop::UringLoop() : EventLoop(false), _ringFd(-1), _sqRing(MAP_FAILED), _cqRing(MAP_FAILED),
+	_sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)), _pending(0), _nextOp(0), _tick(0)
+{
+	LOG_DEBUG("UringLoop constructor called");
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	_ringFd = syscall(SYS_io_uring_setup, _entries, &params);
+	if (_ringFd < 0)
+		throw ServerException("io_uring_setup() error: " + std::string(strerror(errno)));
+	// A timeout for io_uring_enter() needs EXT_ARG, completions must not be dropped on a full queue
+	if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+	{
+		close(_ringFd);
+		throw ServerException("io_uring of this kernel lacks EXT_ARG or NODROP");
+	}
+
+	_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	_sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+	_cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+	_sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES));
+	if (_sqRing == MAP_FAILED || _cqRing == MAP_FAILED || _sqes == MAP_FAILED)
+	{
+		std::string error = strerror(errno);
+		unmapRings();
+		close(_ringFd);
+		throw ServerException("io_uring mmap() error: " + error);
+	}
+
+	char* sq = static_cast<char*>(_sqRing);
+	char* cq = static_cast<char*>(_cqRing);
+	_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+UringLoop::~UringLoop()
+{
+	LOG_DEBUG("UringLoop destructor called");
+
+	// The kernel may still fill the buffers of requests in flight, so they are cancelled and reaped first
+	if (_ringFd >= 0 && _sqRing != MAP_FAILED && _cqRing != MAP_FAILED && _sqes != MAP_FAILED)
+	{
+		std::vector<uint64_t> inFlight;
+		for (const auto& entry : _ops)
+			inFlight.push_back(entry.first);
+		for (uint64_t op : inFlight)
+			cancel(op);
+		struct __kernel_timespec timeout = {0, 100 * 1000000LL};
+		struct io_uring_getevents_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = reinterpret_cast<uint64_t>(&timeout);
+		while (!_ops.empty() && enter(_pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg) >= 0)
+		{
+			_pending = *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+			reapCompletions();
+		}
+	}
+	unmapRings();
+	if (_ringFd >= 0)
+		close(_ringFd);
+}
+
+void UringLoop::unmapRings()
+{
+	if (_sqRing != MAP_FAILED)
+		munmap(_sqRing, _sqRingSize);
+	if (_cqRing != MAP_FAILED)
+		munmap(_cqRing, _cqRingSize);
+	if (_sqes != MAP_FAILED)
+		munmap(_sqes, _sqesSize);
+}
+
+int UringLoop::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg)
+{
+	size_t argSize = arg ? sizeof(struct io_uring_getevents_arg) : 0;
+	return syscall(SYS_io_uring_enter, _ringFd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+void UringLoop::submit()
+{
+	if (enter(_pending, 0, 0, nullptr) < 0)
+		throw ServerException("io_uring_enter() error: " + std::string(strerror(errno)));
+	_pending = *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+}
+
+/* Requests are only queued here, they are submitted by the next wait(), or right away when the queue is full */
+struct io_uring_sqe* UringLoop::getSqe()
+{
+	unsigned tail = *_sqTail;
+	if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) > _sqMask)
+		submit();
+	struct io_uring_sqe* sqe = &_sqes[tail & _sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	_sqArray[tail & _sqMask] = tail & _sqMask;
+	__atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+	_pending++;
+	return sqe;
+}
+
+/* The request owns its buffer, the kernel reads or fills it until the completion is reaped */
+struct io_uring_sqe* UringLoop::queue(OpType type, int fd, uint8_t opcode, std::string buffer, uint64_t& id)
+{
+	id = ++_nextOp;
+	std::unique_ptr<Op>& op = _ops[id];
+	op.reset(new Op{type, fd, _watches[fd].generation, std::move(buffer)});
+
+	struct io_uring_sqe* sqe = getSqe();
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = id;
+	if (type == OpType::RECV)
+	{
+		sqe->addr = reinterpret_cast<uint64_t>(op->buffer.data());
+		sqe->len = op->buffer.size();
+	}
+	return sqe;
+}
+
+/* The request is found by its id, so the fd itself may already be closed. Cancel completions carry id 0 */
+void UringLoop::cancel(uint64_t& op)
+{
+	if (op == 0)
+		return ;
+	struct io_uring_sqe* sqe = getSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = op;
+	op = 0;
+}
+
+/* MSG_WAITALL makes the kernel retry short sends itself, a send still cut short is queued again under its id */
+void UringLoop::submitSend(uint64_t id, std::unique_ptr<Op> op)
+{
+	op->message = {};
+	op->message.msg_iov = op->iov.data();
+	op->message.msg_iovlen = op->iov.size();
+
+	struct io_uring_sqe* sqe = getSqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = op->fd;
+	sqe->addr = reinterpret_cast<uint64_t>(&op->message);
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+	sqe->user_data = id;
+	_ops[id] = std::move(op);
+}
+
+/* Drops the sent bytes from the front of the iovecs, returns whether some are left */
+bool UringLoop::skipSent(Op& op, size_t sent)
+{
+	size_t skipped = 0;
+	while (skipped < op.iov.size() && sent >= op.iov[skipped].iov_len)
+		sent -= op.iov[skipped++].iov_len;
+	op.iov.erase(op.iov.begin(), op.iov.begin() + skipped);
+	if (op.iov.empty())
+		return false;
+	op.iov.front().iov_base = static_cast<char*>(op.iov.front().iov_base) + sent;
+	op.iov.front().iov_len -= sent;
+	return true;
+}
+
+/* A send of a removed fd is cancelled when it is still in flight after _lingerSeconds */
+void UringLoop::linger(int fd, uint64_t send)
+{
+	uint64_t id;
+	struct io_uring_sqe* sqe = queue(OpType::TIMEOUT, fd, IORING_OP_TIMEOUT, std::string(), id);
+	Op& op = *_ops[id];
+	op.target = send;
+	op.timeout.tv_sec = _lingerSeconds;
+	sqe->fd = -1;
+	sqe->addr = reinterpret_cast<uint64_t>(&op.timeout);
+	sqe->len = 1;
+}
+
+UringLoop::Watch* UringLoop::findWatch(int fd, FdKind kind)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _watches.size() || _watches[fd].kind != kind)
+		return nullptr;
+	return &_watches[fd];
+}
+
+/* Queues the fd for update() in the next wait() */
+void UringLoop::touch(int fd)
+{
+	Watch& watch = _watches[fd];
+	if (watch.touched)
+		return ;
+	watch.touched = true;
+	_touched.push_back(fd);
+}
+
+/* Merges with an earlier report of the same tick. Reported fds are looked at again next tick, being level-triggered */
+void UringLoop::report(int fd, short revents)
+{
+	Watch& watch = _watches[fd];
+	if (revents == 0)
+		return ;
+	if (watch.reportedTick == _tick && watch.readyIndex < _ready.size() && _ready[watch.readyIndex].fd == fd)
+		_ready[watch.readyIndex].revents |= revents;
+	else
+	{
+		watch.reportedTick = _tick;
+		watch.readyIndex = _ready.size();
+		_ready.push_back({fd, 0, revents});
+	}
+	touch(fd);
+}
+
+/* Reports what a socket or a pipe can hand over without a syscall */
+void UringLoop::reportReady(int fd)
+{
+	Watch& watch = _watches[fd];
+	if (watch.kind == FdKind::LISTENER)
+	{
+		if ((watch.events & POLLIN) && (!watch.accepted.empty() || watch.acceptError))
+			report(fd, POLLIN);
+	}
+	else if (watch.kind == FdKind::STREAM || watch.kind == FdKind::PIPE)
+	{
+		if ((watch.events & POLLIN) && (watch.inboxOffset < watch.inbox.size() || watch.eof || watch.recvError))
+			report(fd, POLLIN);
+		if ((watch.events & POLLOUT) && watch.sendOp == 0
+			&& (watch.sendError || !(watch.blocked & POLLOUT)))
+			report(fd, POLLOUT);
+	}
+}
+
+/* Reports the fd if it is ready and queues the requests it misses */
+void UringLoop::update(int fd)
+{
+	Watch& watch = _watches[fd];
+	short pollEvents = watch.events;
+
+	reportReady(fd);
+	if (watch.kind == FdKind::LISTENER)
+	{
+		pollEvents = 0;
+		while ((watch.events & POLLIN) && watch.acceptOps.size() < _acceptDepth)
+		{
+			uint64_t op;
+			queue(OpType::ACCEPT, fd, IORING_OP_ACCEPT, std::string(), op)->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+			watch.acceptOps.push_back(op);
+		}
+	}
+	else if (watch.kind == FdKind::STREAM || watch.kind == FdKind::PIPE)
+	{
+		pollEvents = watch.blocked & (watch.events | POLLOUT);
+		if ((watch.events & POLLIN) && watch.recvOp == 0 && !(watch.blocked & POLLIN)
+			&& watch.inboxOffset >= watch.inbox.size() && !watch.eof && !watch.recvError)
+		{
+			if (watch.kind == FdKind::STREAM)
+				queue(OpType::RECV, fd, IORING_OP_RECV, std::string(_recvSize, '\0'), watch.recvOp);
+			else // a pipe has no offset, -1 reads at the current one
+				queue(OpType::RECV, fd, IORING_OP_READ, std::string(_recvSize, '\0'), watch.recvOp)->off = -1ULL;
+		}
+	}
+	if (watch.pollOp != 0 && watch.pollEvents != pollEvents)
+		cancel(watch.pollOp);
+	if (pollEvents != 0 && watch.pollOp == 0)
+	{
+		queue(OpType::POLL, fd, IORING_OP_POLL_ADD, std::string(), watch.pollOp)->poll32_events
+			= static_cast<uint16_t>(pollEvents);
+		watch.pollEvents = pollEvents;
+	}
+}
+
+void UringLoop::add(int fd, short events)
+{
+	if (fd < 0)
+		return ;
+	if (static_cast<size_t>(fd) >= _watches.size())
+		_watches.resize(fd + 1);
+	_watches[fd].events = events;
+	touch(fd);
+}
+
+void UringLoop::modify(int fd, short events)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _watches.size() || _watches[fd].events == events)
+		return ;
+	add(fd, events);
+}
+
+/* Accepted but not taken connections are closed, the completions still in flight get a stale generation */
+void UringLoop::remove(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _watches.size())
+		return ;
+	Watch& watch = _watches[fd];
+	cancel(watch.pollOp);
+	cancel(watch.recvOp);
+	for (uint64_t& op : watch.acceptOps)
+		cancel(op);
+	for (int accepted : watch.accepted)
+		close(accepted);
+
+	uint64_t send = watch.sendOp;
+	uint32_t generation = watch.generation + 1;
+	bool touched = watch.touched;
+	watch = Watch();
+	watch.generation = generation;
+	watch.touched = touched;
+	// The kernel takes its reference to the socket on submission, which has to happen before the fd is closed
+	if (send != 0)
+	{
+		linger(fd, send);
+		if (_pending > 0)
+			submit();
+	}
+	dropReadyEvents(fd);
+}
+
+void UringLoop::complete(uint64_t id, Op& op, int result)
+{
+	Watch& watch = _watches[op.fd];
+	switch (op.type)
+	{
+		case OpType::POLL:
+			// A poll cancelled for other events may complete after its replacement was queued
+			if (watch.pollOp == id)
+				watch.pollOp = 0;
+			if (result < 0)
+				break ;
+			if (watch.kind == FdKind::POLL)
+				report(op.fd, static_cast<short>(result));
+			else if (result & (POLLERR | POLLHUP))
+				watch.blocked = 0;
+			else
+				watch.blocked &= ~result;
+			break ;
+		case OpType::ACCEPT:
+			watch.acceptOps.erase(std::remove(watch.acceptOps.begin(), watch.acceptOps.end(), id),
+				watch.acceptOps.end());
+			if (result >= 0)
+				watch.accepted.push_back(result);
+			else if (result != -EAGAIN && result != -ECANCELED)
+				watch.acceptError = -result;
+			break ;
+		case OpType::RECV:
+			watch.recvOp = 0;
+			if (result > 0)
+			{
+				watch.inbox = std::move(op.buffer);
+				watch.inbox.resize(result);
+				watch.inboxOffset = 0;
+			}
+			else if (result == 0)
+				watch.eof = true;
+			else if (result == -EAGAIN)
+				watch.blocked |= POLLIN;
+			else if (result != -ECANCELED)
+				watch.recvError = -result;
+			break ;
+		case OpType::SEND:
+			watch.sendOp = 0;
+			if (result < 0 && result != -ECANCELED)
+				watch.sendError = -result;
+			break ;
+		case OpType::TIMEOUT:
+			break ;
+	}
+	reportReady(op.fd);
+	touch(op.fd);
+}
+
+/* Completions of a stale generation belong to a removed fd, a connection accepted for it is closed */
+void UringLoop::reapCompletions()
+{
+	unsigned head = *_cqHead;
+	unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++)
+	{
+		const struct io_uring_cqe& cqe = _cqes[head & _cqMask];
+		auto it = _ops.find(cqe.user_data);
+		if (it == _ops.end())
+			continue ;
+		std::unique_ptr<Op> op = std::move(it->second);
+		_ops.erase(it);
+		if (op->type == OpType::SEND && cqe.res > 0 && skipSent(*op, cqe.res))
+			submitSend(cqe.user_data, std::move(op));
+		else if (op->type == OpType::TIMEOUT)
+		{
+			if (_ops.count(op->target))
+				cancel(op->target);
+		}
+		else if (static_cast<size_t>(op->fd) < _watches.size() && _watches[op->fd].generation == op->generation)
+			complete(cqe.user_data, *op, cqe.res);
+		else if (op->type == OpType::ACCEPT && cqe.res >= 0)
+			close(cqe.res);
+	}
+	__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+}
+
+std::vector<struct pollfd>& UringLoop::wait(int timeoutMs)
+{
+	_tick++;
+	_ready.clear();
+	_updating.clear();
+	_updating.swap(_touched);
+	for (int fd : _updating)
+	{
+		_watches[fd].touched = false;
+		update(fd);
+	}
+	if (!_ready.empty() || !_rearmed.empty())
+		timeoutMs = 0;
+
+	struct __kernel_timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000LL};
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	if (timeoutMs >= 0)
+		arg.ts = reinterpret_cast<uint64_t>(&timeout);
+
+	unsigned minComplete = timeoutMs == 0 ? 0 : 1;
+	int submitted = enter(_pending, minComplete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg);
+	if (submitted < 0 && errno != ETIME && errno != EINTR)
+		throw ServerException("io_uring_enter() error: " + std::string(strerror(errno)));
+	// The kernel moves the head past the requests it consumed, even when the wait itself failed
+	_pending = *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+
+	reapCompletions();
+	mergeRearmedEvents();
+	return _ready;
+}
+
+std::string UringLoop::getName() const
+{
+	return "io_uring";
+}
+
+void UringLoop::setKind(int fd, FdKind kind)
+{
+	if (fd < 0)
+		return ;
+	if (static_cast<size_t>(fd) >= _watches.size())
+		_watches.resize(fd + 1);
+	_watches[fd].kind = kind;
+}
+
+/* Takes a connection accepted by a completed IORING_OP_ACCEPT */
+int UringLoop::accept(int listenFd)
+{
+	Watch* watch = findWatch(listenFd, FdKind::LISTENER);
+	if (!watch)
+		return EventLoop::accept(listenFd);
+	touch(listenFd);
+	if (!watch->accepted.empty())
+	{
+		int fd = watch->accepted.front();
+		watch->accepted.pop_front();
+		return fd;
+	}
+	errno = watch->acceptError ? watch->acceptError : EAGAIN;
+	watch->acceptError = 0;
+	return -1;
+}
+
+/* Copies out of the bytes a completed IORING_OP_RECV or IORING_OP_READ left, the next one is queued once they are taken */
+ssize_t UringLoop::receive(int fd, char* buffer, size_t size)
+{
+	Watch* watch = findWatch(fd, FdKind::STREAM);
+	if (!watch)
+		watch = findWatch(fd, FdKind::PIPE);
+	if (!watch)
+		return EventLoop::receive(fd, buffer, size);
+	touch(fd);
+	if (watch->inboxOffset < watch->inbox.size())
+	{
+		size_t length = std::min(size, watch->inbox.size() - watch->inboxOffset);
+		memcpy(buffer, watch->inbox.data() + watch->inboxOffset, length);
+		watch->inboxOffset += length;
+		if (watch->inboxOffset == watch->inbox.size())
+		{
+			watch->inbox.clear();
+			watch->inboxOffset = 0;
+		}
+		return length;
+	}
+	if (watch->recvError)
+	{
+		errno = watch->recvError;
+		watch->recvError = 0;
+		return -1;
+	}
+	if (watch->eof)
+		return 0;
+	errno = EAGAIN;
+	return -1;
+}
+
+/**
+ * Queues the iovecs as they are, the buffers they point into stay pinned in the
+ * request, and reports them all as sent. The next send waits for the
+ * completion, a failed send is returned by it
+ */
+ssize_t UringLoop::send(int fd, const struct iovec* iov, int count, SendBuffers buffers)
+{
+	Watch* watch = findWatch(fd, FdKind::STREAM);
+	if (!watch)
+		return EventLoop::send(fd, iov, count, std::move(buffers));
+	touch(fd);
+	if (watch->sendError)
+	{
+		errno = watch->sendError;
+		watch->sendError = 0;
+		return -1;
+	}
+	if (watch->sendOp != 0 || (watch->blocked & POLLOUT))
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	std::unique_ptr<Op> op(new Op{OpType::SEND, fd, watch->generation, std::string()});
+	op->iov.assign(iov, iov + count);
+	op->pinned = std::move(buffers);
+	ssize_t total = 0;
+	for (int i = 0; i < count; i++)
+		total += iov[i].iov_len;
+	watch->sendOp = ++_nextOp;
+	submitSend(watch->sendOp, std::move(op));
+	return total;
+}
+
+/* File bodies keep going out by sendfile(), a full socket buffer is waited for with a poll */
+ssize_t UringLoop::sendFile(int fd, int fileFd, off_t* offset, size_t count)
+{
+	Watch* watch = findWatch(fd, FdKind::STREAM);
+	if (!watch)
+		return EventLoop::sendFile(fd, fileFd, offset, count);
+	if (watch->sendOp != 0 || (watch->blocked & POLLOUT))
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+	ssize_t sent = EventLoop::sendFile(fd, fileFd, offset, count);
+	if (sent < 0 && errno == EAGAIN)
+	{
+		watch->blocked |= POLLOUT;
+		touch(fd);
+	}
+	return sent;
+}
@@ -0,0 +1,160 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UringLoop.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/30 17:25:09 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/04 11:20:05 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "EventLoop.hpp"
+#include <linux/io_uring.h>
+#include <sys/mman.h> // mmap()
+#include <sys/syscall.h> // SYS_io_uring_setup, SYS_io_uring_enter
+#include <sys/socket.h> // struct msghdr
+#include <unistd.h> // syscall(), close()
+#include <errno.h>
+#include <cstring> // strerror(), memset(), memcpy()
+#include <cstdint>
+#include <algorithm> // std::remove(), std::min()
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * io_uring backend, built with `make URING=1`. Listeners and client sockets
+ * are not polled: the loop keeps IORING_OP_ACCEPT and IORING_OP_RECV requests
+ * in flight on them. accept() and receive() hand over the results of completed
+ * requests, send() queues an IORING_OP_SENDMSG over the caller's iovecs and
+ * returns their length at once, so none of them makes a syscall. CGI stdout
+ * pipes are read the same way with IORING_OP_READ, the other fds (CGI stdin,
+ * inotify) are watched with one-shot IORING_OP_POLL_ADD. Everything a tick
+ * queued goes to the kernel in the io_uring_enter() which waits for the next
+ * completions.
+ *
+ * A socket is reported readable while received bytes, EOF or an error wait to
+ * be taken, and writable while no send is in flight, so the backend is
+ * level-triggered. Every request owns or pins its buffers until its
+ * completion is reaped. remove() cancels the requests of the fd and bumps the
+ * generation of its watch, completions of an older generation are dropped
+ * even when the fd number is already reused. A send in flight is not
+ * cancelled, its bytes were already reported as sent: it may finish on the
+ * closed connection for up to _lingerSeconds.
+ */
+class UringLoop : public EventLoop
+{
+	private:
+		static constexpr unsigned			_entries = 256;
+		static constexpr size_t				_recvSize = 16 * 1024; // buffer of a receive in flight, one per client
+		static constexpr size_t				_acceptDepth = 4; // accepts in flight per listener
+		static constexpr long				_lingerSeconds = 60; // as the default sendTimeout
+
+		enum class OpType
+		{
+			POLL,
+			ACCEPT,
+			RECV,
+			SEND,
+			TIMEOUT // ends a send left in flight by remove()
+		};
+
+		struct Op
+		{
+			OpType							type;
+			int								fd;
+			uint32_t						generation;
+			std::string						buffer; // filled by a receive
+			std::vector<struct iovec>		iov = {}; // what a send has left, pointing into pinned
+			SendBuffers						pinned = {};
+			struct msghdr					message = {};
+			uint64_t						target = 0; // send a timeout cancels
+			struct __kernel_timespec		timeout = {};
+		};
+
+		/* Requests in flight are kept by id, 0 stands for none */
+		struct Watch
+		{
+			short							events = 0;
+			uint32_t						generation = 0;
+			FdKind							kind = FdKind::POLL;
+			bool							touched = false; // looked at by the next wait()
+			uint64_t						pollOp = 0;
+			short							pollEvents = 0;
+			short							blocked = 0; // events a socket waits for with a poll after EAGAIN
+			uint64_t						recvOp = 0;
+			std::string						inbox; // received bytes not taken by receive() yet
+			size_t							inboxOffset = 0;
+			bool							eof = false;
+			int								recvError = 0;
+			uint64_t						sendOp = 0;
+			int								sendError = 0;
+			std::vector<uint64_t>			acceptOps;
+			std::deque<int>					accepted;
+			int								acceptError = 0;
+			uint64_t						reportedTick = 0;
+			size_t							readyIndex = 0; // in _ready, during reportedTick
+		};
+
+		int									_ringFd;
+		void*								_sqRing;
+		void*								_cqRing;
+		struct io_uring_sqe*				_sqes;
+		size_t								_sqRingSize;
+		size_t								_cqRingSize;
+		size_t								_sqesSize;
+
+		unsigned*							_sqHead;
+		unsigned*							_sqTail;
+		unsigned							_sqMask;
+		unsigned*							_sqArray;
+		unsigned*							_cqHead;
+		unsigned*							_cqTail;
+		unsigned							_cqMask;
+		struct io_uring_cqe*				_cqes;
+
+		unsigned							_pending; // prepared but not submitted requests
+		uint64_t							_nextOp;
+		uint64_t							_tick;
+		std::unordered_map<uint64_t, std::unique_ptr<Op>>	_ops;
+		std::vector<Watch>					_watches;
+		std::vector<int>					_touched;
+		std::vector<int>					_updating;
+
+		struct io_uring_sqe*				getSqe();
+		int									enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg);
+		void								submit();
+		struct io_uring_sqe*				queue(OpType type, int fd, uint8_t opcode, std::string buffer, uint64_t& id);
+		void								cancel(uint64_t& op);
+		void								submitSend(uint64_t id, std::unique_ptr<Op> op);
+		void								linger(int fd, uint64_t send);
+		static bool							skipSent(Op& op, size_t sent);
+		Watch*								findWatch(int fd, FdKind kind);
+		void								touch(int fd);
+		void								report(int fd, short revents);
+		void								reportReady(int fd);
+		void								update(int fd);
+		void								complete(uint64_t id, Op& op, int result);
+		void								reapCompletions();
+		void								unmapRings();
+
+	public:
+		UringLoop();
+		~UringLoop();
+
+		void								add(int fd, short events) override;
+		void								modify(int fd, short events) override;
+		void								remove(int fd) override;
+		std::vector<struct pollfd>&			wait(int timeoutMs) override;
+		std::string							getName() const override;
+
+		void								setKind(int fd, FdKind kind) override;
+		int									accept(int listenFd) override;
+		ssize_t								receive(int fd, char* buffer, size_t size) override;
+		ssize_t								send(int fd, const struct iovec* iov, int count, SendBuffers buffers) override;
+		ssize_t								sendFile(int fd, int fileFd, off_t* offset, size_t count) override;
+};
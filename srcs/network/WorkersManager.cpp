@@ -0,0 +1,166 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   WorkersManager.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/19 09:48:26 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "WorkersManager.hpp"
+
+std::vector<pid_t> WorkersManager::_workers;
+std::vector<std::chrono::steady_clock::time_point> WorkersManager::_startTimes;
+std::vector<int> WorkersManager::_cpus;
+size_t WorkersManager::_threadsCount = 1;
+
+int WorkersManager::run(size_t workersCount, size_t threadsCount, const std::vector<int>& cpus)
+{
+	_threadsCount = threadsCount;
+	_cpus = cpus;
+	_workers.assign(workersCount, -1);
+	_startTimes.assign(workersCount, std::chrono::steady_clock::now());
+
+	LOG_INFO("Master process (pid: ", getpid(), ") starts ", workersCount, " workers");
+	for (size_t slot = 0; slot < workersCount; slot++)
+		spawnWorker(slot);
+
+	// Polled, so a signal is noticed even though waitpid() is restarted after the handler
+	while (!g_signalReceived.load() && hasWorkers())
+	{
+		if (g_statsRequested.exchange(false))
+			signalWorkers(SIGUSR1);
+		int status;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+		if (pid == 0)
+		{
+			usleep(_waitIntervalUs);
+			continue ;
+		}
+		if (pid < 0)
+		{
+			if (errno == EINTR)
+				continue ;
+			break ;
+		}
+		int slot = findSlot(pid);
+		if (slot < 0)
+			continue ;
+		_workers[slot] = -1;
+		if (g_signalReceived.load())
+			break ;
+
+		// A worker which fails right after start would fail again, e.g. its ports can not be bound
+		auto lifetime = std::chrono::steady_clock::now() - _startTimes[slot];
+		if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS && lifetime < std::chrono::seconds(1))
+		{
+			LOG_ERROR("Worker #", slot, " (pid: ", pid, ") failed on start and will not be respawned");
+			continue ;
+		}
+		LOG_WARNING("Worker #", slot, " (pid: ", pid, ") exited, respawning");
+		spawnWorker(slot);
+	}
+	bool failed = !g_signalReceived.load();
+	stopWorkers();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+pid_t WorkersManager::spawnWorker(size_t slot)
+{
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		LOG_ERROR("Failed to fork worker #", slot, ": ", strerror(errno));
+		return -1;
+	}
+	if (pid == 0)
+		runWorker(slot);
+
+	_workers[slot] = pid;
+	_startTimes[slot] = std::chrono::steady_clock::now();
+	LOG_INFO("Worker #", slot, " started with pid: ", pid);
+	return pid;
+}
+
+/* Worker side, runs its own event loops and never returns */
+void WorkersManager::runWorker(size_t slot)
+{
+	int exitCode = EXIT_FAILURE;
+	pinToCpu(slot);
+	try
+	{
+		exitCode = ReactorsManager::run(_threadsCount);
+	}
+	catch (const ServerException& e)
+	{
+		LOG_ERROR("Worker #", slot, " closed with error: ", e.what(), ", errno: ", e.getErrno());
+	}
+	catch (const std::exception& e)
+	{
+		LOG_ERROR("Worker #", slot, " closed with exception: ", e.what());
+	}
+	std::exit(exitCode);
+}
+
+/* Worker i runs on the CPU number i of the workerCpuAffinity list, the list is reused when it is shorter */
+void WorkersManager::pinToCpu(size_t slot)
+{
+	if (_cpus.empty())
+		return ;
+	int cpu = _cpus[slot % _cpus.size()];
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) < 0)
+	{
+		LOG_WARNING("Worker #", slot, " can not be pinned to CPU ", cpu, ": ", strerror(errno));
+		return ;
+	}
+	LOG_DEBUG("Worker #", slot, " pinned to CPU ", cpu);
+}
+
+int WorkersManager::findSlot(pid_t pid)
+{
+	for (size_t slot = 0; slot < _workers.size(); slot++)
+	{
+		if (_workers[slot] == pid)
+			return slot;
+	}
+	return -1;
+}
+
+bool WorkersManager::hasWorkers()
+{
+	for (pid_t pid : _workers)
+	{
+		if (pid > 0)
+			return true;
+	}
+	return false;
+}
+
+void WorkersManager::signalWorkers(int signal)
+{
+	for (pid_t pid : _workers)
+	{
+		if (pid > 0)
+			kill(pid, signal);
+	}
+}
+
+/* Forwards SIGTERM to the workers still running and waits for each of them before exiting */
+void WorkersManager::stopWorkers()
+{
+	for (pid_t& pid : _workers)
+	{
+		if (pid <= 0)
+			continue ;
+		kill(pid, SIGTERM);
+		waitpid(pid, nullptr, 0);
+		pid = -1;
+	}
+	LOG_INFO("All workers stopped");
+}
@@ -0,0 +1,51 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   WorkersManager.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/08/19 09:48:26 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "ReactorsManager.hpp"
+#include "../utils/logUtils.hpp"
+#include "../utils/globals.hpp"
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring> // strerror()
+#include <sched.h> // sched_setaffinity()
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Master side of the multi-process mode. Forks the workers, each worker runs
+ * its own event loops with SO_REUSEPORT listeners, so the kernel spreads the
+ * connections between them. On a signal the master forwards SIGTERM to them
+ */
+class WorkersManager
+{
+	private:
+		static std::vector<pid_t>									_workers; // pid per worker slot, -1 if the slot is free
+		static std::vector<std::chrono::steady_clock::time_point>	_startTimes;
+		static std::vector<int>										_cpus;
+		static size_t												_threadsCount;
+		static const int											_waitIntervalUs = 100000;
+
+		static pid_t												spawnWorker(size_t slot);
+		[[noreturn]] static void									runWorker(size_t slot);
+		static void													pinToCpu(size_t slot);
+		static int													findSlot(pid_t pid);
+		static bool													hasWorkers();
+		static void													signalWorkers(int signal);
+		static void													stopWorkers();
+
+	public:
+		static int													run(size_t workersCount, size_t threadsCount, const std::vector<int>& cpus);
+};
@@ -0,0 +1,126 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChunkedDecoder.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/30 13:21:40 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ChunkedDecoder.hpp"
+
+/**
+ * Takes as much of data as belongs to the body and returns how many bytes that
+ * was. Bytes after the last chunk and the trailers are left to the caller, they
+ * belong to the next pipelined request
+ */
+size_t ChunkedDecoder::decode(const char* data, size_t length, RequestBody& body)
+{
+	size_t pos = 0;
+
+	while (pos < length && _state != State::DONE)
+	{
+		if (_state == State::DATA)
+		{
+			size_t taken = std::min(_chunkRemaining, length - pos);
+			body.append(data + pos, taken);
+			pos += taken;
+			_chunkRemaining -= taken;
+			if (_chunkRemaining == 0)
+				_state = State::DATA_END;
+			continue ;
+		}
+
+		size_t lineEnd = Scanner::find(std::string_view(data + pos, length - pos), '\n');
+		size_t end = lineEnd == std::string::npos ? length : pos + lineEnd;
+		_line.append(data + pos, end - pos);
+		if (_line.size() > _maxLine)
+			throw ProcessingError(400, {}, "Chunk line is too long");
+		if (lineEnd == std::string::npos)
+			return length;
+		pos = end + 1;
+		if (_line.empty() || _line.back() != '\r')
+			throw ProcessingError(400, {}, "Chunk line does not end with CRLF");
+		_line.pop_back();
+		parseLine(_line, body.size());
+		_line.clear();
+	}
+	return pos;
+}
+
+void ChunkedDecoder::parseLine(std::string_view line, size_t bodySize)
+{
+	switch (_state)
+	{
+		case State::SIZE:
+			parseSize(line, bodySize);
+			break ;
+		case State::DATA_END:
+			if (!line.empty())
+				throw ProcessingError(400, {}, "Chunk data is longer than its size");
+			_state = State::SIZE;
+			break ;
+		case State::TRAILERS:
+			if (line.empty())
+				_state = State::DONE;
+			else
+				parseTrailer(line);
+			break ;
+		default:
+			break ;
+	}
+}
+
+/* A chunk which would take the body past the max body size is refused before its data is read */
+void ChunkedDecoder::parseSize(std::string_view line, size_t bodySize)
+{
+	std::string_view size = Scanner::trim(line.substr(0, line.find(';'))); // chunk extensions are ignored
+	size_t chunkSize = 0;
+
+	auto [end, error] = std::from_chars(size.data(), size.data() + size.size(), chunkSize, 16);
+	if (size.empty() || error != std::errc() || end != size.data() + size.size())
+		throw ProcessingError(400, {}, "Invalid chunk size");
+	if (chunkSize > _maxBodySize || bodySize > _maxBodySize - chunkSize)
+		throw ProcessingError(413, {}, "Chunked body is larger than clientMaxBodySize");
+	_chunkRemaining = chunkSize;
+	_state = chunkSize == 0 ? State::TRAILERS : State::DATA;
+}
+
+/* Fields which frame or route the request can not come as trailers, they are dropped */
+void ChunkedDecoder::parseTrailer(std::string_view line)
+{
+	_trailersSize += line.size() + 2;
+	if (_trailersSize > _maxTrailers)
+		throw ProcessingError(431, {}, "Request trailers are too large");
+
+	size_t colonPos = Scanner::find(line, ':');
+	if (colonPos == std::string::npos)
+		return ;
+	std::string name(Scanner::trim(line.substr(0, colonPos)));
+	std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+	if (name.empty() || name == "content-length" || name == "transfer-encoding" || name == "host")
+		return ;
+	_trailers[name] = std::string(Scanner::trim(line.substr(colonPos + 1)));
+}
+
+/**
+ * Getters and setters
+ */
+
+bool ChunkedDecoder::isDone() const
+{
+	return _state == State::DONE;
+}
+
+const std::map<std::string, std::string>& ChunkedDecoder::getTrailers() const
+{
+	return _trailers;
+}
+
+void ChunkedDecoder::setMaxBodySize(size_t maxBodySize)
+{
+	_maxBodySize = maxBodySize;
+}
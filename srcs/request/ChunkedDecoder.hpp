@@ -0,0 +1,67 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChunkedDecoder.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/30 13:21:40 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "../utils/ServerException.hpp"
+#include "../utils/Scanner.hpp"
+#include "RequestBody.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv> // std::from_chars()
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+
+/**
+ * Decodes a chunked body while it arrives. Chunk data is appended to the body
+ * as soon as it is read, only a size or trailer line split between two reads
+ * is kept. The decoded body may not grow past the max body size (413), chunk
+ * lines may not be longer than _maxLine (400) and trailers not larger than
+ * _maxTrailers (431)
+ */
+class ChunkedDecoder
+{
+	public:
+		enum class State
+		{
+			SIZE,
+			DATA,
+			DATA_END,
+			TRAILERS,
+			DONE
+		};
+
+	private:
+		State								_state = State::SIZE;
+		std::string							_line; // start of a line the previous read ended in
+		size_t								_chunkRemaining = 0;
+		size_t								_maxBodySize = std::numeric_limits<size_t>::max();
+		size_t								_trailersSize = 0;
+		std::map<std::string, std::string>	_trailers;
+
+		static constexpr size_t				_maxLine = 8 * 1024;
+		static constexpr size_t				_maxTrailers = 32 * 1024;
+
+		void								parseLine(std::string_view line, size_t bodySize);
+		void								parseSize(std::string_view line, size_t bodySize);
+		void								parseTrailer(std::string_view line);
+
+	public:
+		size_t								decode(const char* data, size_t length, RequestBody& body);
+
+		/* Getters and setters */
+		bool								isDone() const;
+		const std::map<std::string, std::string>&	getTrailers() const;
+		void								setMaxBodySize(size_t maxBodySize);
+};
@@ -6,7 +6,7 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:08:37 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/06 15:31:13 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -15,6 +15,7 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <cstdlib>
 
 Request::Request()
 {
@@ -46,24 +47,14 @@ void Request::parseHeaders(std::vector<std::string> headerLines)
 	}
 }
 
+/* The body was decoded while it arrived, it is moved here, not copied */
 void Request::parseBody(Client& client)
 {
-
 	if (client.getIsBodyRead())
-	{
-		std::string body = Utility::trim(client.getRequestString().substr(client.getEmptyLinePos() + 2));
-		// Unchunk the body if necessary
-		if (_headers.find("transfer-encoding") != _headers.end()
-			&& Utility::strToLower(_headers["transfer-encoding"]) == "chunked")
-		{
-			_body = unchunkBody(body);
-		}
-		else
-		{
-			// Parse the body
-			_body = Utility::trim(body);
-		}
-	}
+		_body = std::move(client.getRequestBody());
+	// Trailers of a chunked body add to the headers, they do not replace them
+	for (auto& [name, value] : client.getParser().getTrailers())
+		_headers.insert({name, value});
 }
 
 void Request::parse(Client& client)
@@ -101,65 +92,6 @@ void Request::parse(Client& client)
 	}
 }
 
-/*
-In HTTP/1.1, chunked transfer encoding strictly requires the use of \r\n
-(carriage return and line feed) to delimit the chunk size and the actual
-data. This specification is defined in the HTTP/1.1 standard (RFC 7230,
-Section 4.1). Using just \n (line feed) would not conform to the standard
-and could result in improper parsing by HTTP clients and servers.
-*/
-
-size_t Request::hexStringToSizeT(const std::string &hexStr)
-{
-	std::istringstream iss(hexStr);
-	size_t size;
-	iss >> std::hex >> size;
-	return size;
-}
-
-std::string Request::unchunkBody(std::string& string)
-{
-	LOG_DEBUG("Request::unchunkBody() called");
-	std::string unchunkedData;
-	std::istringstream stream(string);
-
-	int count = 0;
-
-	while (true)
-	{
-		count++;
-		std::string chunkSizeStr = Utility::readLine(stream);
-		size_t chunkSize = hexStringToSizeT(chunkSizeStr);
-
-		LOG_DEBUG(TEXT_YELLOW, "chunkSize: ", chunkSize, RESET);
-
-		if (chunkSize == 0) {
-			break;
-		}
-
-		// Read the chunk data using substr
-		std::string chunkData;
-		chunkData.reserve(chunkSize);
-
-		for (size_t i = 0; i < chunkSize; ++i) {
-			char c;
-			stream.get(c);
-			chunkData += c;
-		}
-		unchunkedData += chunkData;
-
-		// Read the trailing \r\n after chunk data
-		std::string crlf;
-		std::getline(stream, crlf);
-		LOG_DEBUG(unchunkedData);
-		if (count > 300)
-			break;
-	}
-
-	return unchunkedData;
-}
-
-
 /**
  * Getters
  */
@@ -174,7 +106,7 @@ Request::QueryStringParameters Request::getHeaders()
 	return _headers;
 }
 
-std::string Request::getBody()
+RequestBody& Request::getBody()
 {
 	return _body;
 }
@@ -185,6 +117,39 @@ void	Request::setHeader(std::string key, std::string value)
 	_headers[key] = value;
 }
 
+/**
+ * True when Accept-Encoding allows the coding, by name or with `*`. A name
+ * listed explicitly wins over `*`, q=0 means the coding is refused
+ */
+bool	Request::acceptsEncoding(const std::string& coding)
+{
+	auto header = _headers.find("accept-encoding");
+	if (header == _headers.end())
+		return false;
+
+	int explicitlyAccepted = -1;
+	int starAccepted = -1;
+	for (const std::string& item : Utility::splitStr(header->second, ","))
+	{
+		std::vector<std::string> params = Utility::splitStr(item, ";");
+		if (params.empty())
+			continue ;
+		std::string name = Utility::strToLower(Utility::trim(params[0]));
+		bool accepted = true;
+		for (size_t i = 1; i < params.size(); i++)
+		{
+			std::string param = Utility::trim(params[i]);
+			if (param.rfind("q=", 0) == 0 && std::strtod(param.c_str() + 2, nullptr) <= 0)
+				accepted = false;
+		}
+		if (name == coding)
+			explicitlyAccepted = accepted;
+		else if (name == "*")
+			starAccepted = accepted;
+	}
+	return explicitlyAccepted != -1 ? explicitlyAccepted == 1 : starAccepted == 1;
+}
+
 void	Request::printRequest()
 {
 	int limitRequestString = 2000;
@@ -195,6 +160,6 @@ void	Request::printRequest()
 	for (auto& [key, value] : getHeaders())
 		LOG_DEBUG("Header: ", key, " = ", value);
 	LOG_DEBUG_RAW("[DEBUG] Body: ", "\n");
-	LOG_DEBUG_RAW(getBody().substr(0, limitRequestString));
+	LOG_DEBUG_RAW(getBody().read(0, limitRequestString));
 	LOG_DEBUG_RAW("\n...\n");
 }
@@ -6,7 +6,7 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:08:40 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/06 15:30:41 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "../network/Client.hpp"
+#include "RequestBody.hpp"
 #include "../utils/Utility.hpp"
 #include "../utils/logUtils.hpp"
 #include "../config/Config.hpp"
@@ -33,12 +34,8 @@ class Request
 	private:
 		QueryStringParameters	_startLine;
 		QueryStringParameters	_headers;
-		std::string				_body;
+		RequestBody				_body;
 
-		/* Unchunk request */
-		size_t					hexStringToSizeT(const std::string &hexStr);
-		std::string				unchunkBody(std::string& body);
-		
 	public:
 		Request();
 		Request(Client& client);
@@ -50,8 +47,9 @@ class Request
 		/* Getters and setters */
 		QueryStringParameters	getStartLine();
 		QueryStringParameters	getHeaders();
-		std::string				getBody();
+		RequestBody&			getBody();
 		void					setHeader(std::string key, std::string value);
+		bool					acceptsEncoding(const std::string& coding);
 
 		void					printRequest();
 };
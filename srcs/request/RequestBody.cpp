@@ -0,0 +1,225 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RequestBody.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 15:42:07 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "RequestBody.hpp"
+
+RequestBody::~RequestBody()
+{
+	if (_fd != -1)
+		close(_fd);
+}
+
+RequestBody::RequestBody(RequestBody&& other) noexcept
+	: _data(std::move(other._data)), _fd(std::exchange(other._fd, -1)), _size(std::exchange(other._size, 0)),
+	_threshold(other._threshold), _directory(std::move(other._directory)) {}
+
+RequestBody& RequestBody::operator=(RequestBody&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (_fd != -1)
+			close(_fd);
+		_data = std::move(other._data);
+		_fd = std::exchange(other._fd, -1);
+		_size = std::exchange(other._size, 0);
+		_threshold = other._threshold;
+		_directory = std::move(other._directory);
+	}
+	return *this;
+}
+
+/* A write to the spool file which fails (e.g. the disk is full) fails the request */
+void RequestBody::append(const char* data, size_t length)
+{
+	if (length == 0)
+		return ;
+	if (_fd == -1 && _size + length > _threshold)
+		spool();
+	if (_fd == -1)
+		_data.append(data, length);
+	else if (!writeAll(_fd, data, length))
+		throw ProcessingError(500, {}, "Exception has been thrown in append() method of RequestBody class");
+	_size += length;
+}
+
+/**
+ * O_TMPFILE gives a file which never has a name. Where the filesystem does not
+ * support it, a named file is created and unlinked right away
+ */
+void RequestBody::spool()
+{
+	int fd = open(_directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+	if (fd == -1)
+	{
+		std::string path = _directory + "/webserv-body-XXXXXX";
+		fd = mkostemp(path.data(), O_CLOEXEC);
+		if (fd != -1)
+			unlink(path.c_str());
+	}
+	if (fd == -1 || !writeAll(fd, _data.data(), _data.size()))
+	{
+		if (fd != -1)
+			close(fd);
+		throw ProcessingError(500, {}, "Exception has been thrown in spool() method of RequestBody class");
+	}
+	LOG_DEBUG("Request body spooled to ", _directory, ", bytes: ", _data.size());
+	_fd = fd;
+	std::string().swap(_data); // the memory goes back, clear() would keep it
+}
+
+bool RequestBody::writeAll(int fd, const char* data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(fd, data, length);
+		if (written < 0 && errno == EINTR)
+			continue ;
+		if (written <= 0)
+			return false;
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+/* The file offset is only moved by append(), parts are read with pread() */
+size_t RequestBody::readAt(size_t offset, char* data, size_t length) const
+{
+	size_t done = 0;
+
+	while (done < length)
+	{
+		ssize_t bytesRead = pread(_fd, data + done, length - done, offset + done);
+		if (bytesRead < 0 && errno == EINTR)
+			continue ;
+		if (bytesRead <= 0)
+			break ;
+		done += bytesRead;
+	}
+	return done;
+}
+
+std::string RequestBody::read(size_t offset, size_t length) const
+{
+	if (offset >= _size)
+		return "";
+	length = std::min(length, _size - offset);
+	if (_fd == -1)
+		return _data.substr(offset, length);
+	std::string part(length, '\0');
+	part.resize(readAt(offset, part.data(), length));
+	return part;
+}
+
+/**
+ * Searches [from, to) as std::string::find does. A spooled body is read in
+ * blocks which overlap by needle.size() - 1 bytes, so a needle split between
+ * two blocks is still found
+ */
+size_t RequestBody::find(std::string_view needle, size_t from, size_t to) const
+{
+	to = std::min(to, _size);
+	if (from > to || needle.size() > to - from)
+		return std::string::npos;
+	if (_fd == -1)
+		return Scanner::find(std::string_view(_data).substr(0, to), needle, from);
+
+	std::string block(std::max(_blockSize, needle.size() * 2), '\0');
+	while (to - from >= needle.size())
+	{
+		size_t length = readAt(from, block.data(), std::min(block.size(), to - from));
+		size_t found = Scanner::find(std::string_view(block.data(), length), needle);
+		if (found != std::string::npos)
+			return from + found;
+		if (length < needle.size() || from + length >= to)
+			break ;
+		from += length - needle.size() + 1;
+	}
+	return std::string::npos;
+}
+
+/**
+ * Writes length bytes from offset to the end of fd. A spooled body is copied
+ * in the kernel with copy_file_range(), the bytes do not pass through the server
+ */
+bool RequestBody::copyTo(int fd, size_t offset, size_t length) const
+{
+	if (offset > _size || length > _size - offset)
+		return false;
+	if (_fd == -1)
+		return writeAll(fd, _data.data() + offset, length);
+
+	loff_t from = static_cast<loff_t>(offset);
+	while (length > 0)
+	{
+		ssize_t copied = copy_file_range(_fd, &from, fd, nullptr, length, 0);
+		if (copied < 0 && errno == EINTR)
+			continue ;
+		if (copied <= 0)
+			break ;
+		length -= copied;
+	}
+	// What copy_file_range() could not copy (e.g. across filesystems on older kernels) goes through a buffer
+	std::string block(std::min(length, _blockSize), '\0');
+	while (length > 0)
+	{
+		size_t bytesRead = readAt(from, block.data(), std::min(length, block.size()));
+		if (bytesRead == 0 || !writeAll(fd, block.data(), bytesRead))
+			return false;
+		from += bytesRead;
+		length -= bytesRead;
+	}
+	return true;
+}
+
+/* Closing the spool fd frees the file */
+void RequestBody::clear()
+{
+	if (_fd != -1)
+		close(_fd);
+	_fd = -1;
+	_data.clear();
+	_size = 0;
+	_threshold = std::numeric_limits<size_t>::max();
+	_directory.clear();
+}
+
+/**
+ * Getters and setters
+ */
+
+size_t RequestBody::size() const
+{
+	return _size;
+}
+
+bool RequestBody::empty() const
+{
+	return _size == 0;
+}
+
+bool RequestBody::isSpooled() const
+{
+	return _fd != -1;
+}
+
+int RequestBody::getFd() const
+{
+	return _fd;
+}
+
+/* Bodies larger than threshold bytes go to a temp file in directory */
+void RequestBody::setSpool(size_t threshold, const std::string& directory)
+{
+	_threshold = threshold;
+	_directory = directory;
+}
@@ -0,0 +1,72 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RequestBody.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 15:42:07 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "../utils/ServerException.hpp"
+#include "../utils/Scanner.hpp"
+#include "../utils/logUtils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib> // mkostemp()
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility> // std::exchange()
+#include <fcntl.h> // open(), O_TMPFILE
+#include <unistd.h> // pread(), write(), unlink(), close()
+
+/**
+ * The decoded body of a request. It is kept in memory until it grows past the
+ * threshold, then it is moved to a temp file without a name in the spool
+ * directory and the rest is appended there, so a large upload takes disk, not
+ * memory. The file goes away when the fd is closed. The body is read back in
+ * parts with read(), find() and copyTo(), from memory or from the file alike
+ */
+class RequestBody
+{
+	private:
+		std::string					_data; // the body while it is not spooled
+		int							_fd = -1;
+		size_t						_size = 0;
+		size_t						_threshold = std::numeric_limits<size_t>::max();
+		std::string					_directory;
+
+		static constexpr size_t		_blockSize = 64 * 1024;
+
+		void						spool();
+		size_t						readAt(size_t offset, char* data, size_t length) const;
+		static bool					writeAll(int fd, const char* data, size_t length);
+
+	public:
+		RequestBody() = default;
+		~RequestBody();
+
+		RequestBody(const RequestBody&) = delete;
+		RequestBody& operator=(const RequestBody&) = delete;
+		RequestBody(RequestBody&& other) noexcept;
+		RequestBody& operator=(RequestBody&& other) noexcept;
+
+		void						append(const char* data, size_t length);
+		std::string					read(size_t offset, size_t length) const;
+		size_t						find(std::string_view needle, size_t from = 0,
+										size_t to = std::string::npos) const;
+		bool						copyTo(int fd, size_t offset, size_t length) const;
+		void						clear();
+
+		/* Getters and setters */
+		size_t						size() const;
+		bool						empty() const;
+		bool						isSpooled() const;
+		int							getFd() const;
+		void						setSpool(size_t threshold, const std::string& directory);
+};
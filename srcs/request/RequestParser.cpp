@@ -0,0 +1,220 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RequestParser.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/25 10:13:29 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "RequestParser.hpp"
+
+static bool equalsIgnoreCase(std::string_view str, std::string_view lower)
+{
+	if (str.size() != lower.size())
+		return false;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if (std::tolower(static_cast<unsigned char>(str[i])) != lower[i])
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Goes on from where the previous call stopped and returns true once the whole
+ * request is read. It stops after the headers, so the caller can set the max
+ * body size before the body is read. Body bytes are appended to body and
+ * dropped from the buffer, bytes after the end of the request are not looked
+ * at, they belong to the next pipelined request
+ */
+bool RequestParser::parse(std::string& buffer, RequestBody& body)
+{
+	std::string_view line;
+	size_t bodyStart = _pos;
+
+	while (_state != State::DONE && _pos < buffer.size())
+	{
+		switch (_state)
+		{
+			case State::REQUEST_LINE:
+				if (!nextLine(buffer, line))
+					return false;
+				// Empty lines before a request line are skipped
+				if (!line.empty())
+				{
+					_headersStart = _pos;
+					_state = State::HEADERS;
+				}
+				break ;
+			case State::HEADERS:
+				if (!nextLine(buffer, line))
+					return false;
+				if (!line.empty())
+				{
+					parseHeaderLine(line);
+					break ;
+				}
+				endHeaders();
+				return _state == State::DONE;
+			case State::BODY:
+			{
+				size_t taken = std::min(_contentLength - body.size(), buffer.size() - _pos);
+				body.append(buffer.data() + _pos, taken);
+				_pos += taken;
+				if (body.size() == _contentLength)
+					_state = State::DONE;
+				break ;
+			}
+			case State::CHUNKED_BODY:
+				_pos += _decoder.decode(buffer.data() + _pos, buffer.size() - _pos, body);
+				if (_decoder.isDone())
+					_state = State::DONE;
+				break ;
+			case State::DONE:
+				break ;
+		}
+	}
+	// What was moved to the body leaves the buffer, only the headers and unread bytes stay
+	if (isHeadersDone() && _pos > bodyStart)
+	{
+		_bodyBytes += _pos - bodyStart;
+		buffer.erase(bodyStart, _pos - bodyStart);
+		_pos = bodyStart;
+		_lineStart = _pos;
+	}
+	return _state == State::DONE;
+}
+
+void RequestParser::reset()
+{
+	*this = RequestParser();
+}
+
+/**
+ * Takes the next CRLF terminated line. When the line is not complete yet the
+ * position moves to the end of the buffer, so the next read is searched from
+ * there, and the size limits are checked on what arrived so far
+ */
+bool RequestParser::nextLine(const std::string& buffer, std::string_view& line)
+{
+	size_t lineEnd = Scanner::find(buffer, '\n', _pos);
+
+	_pos = lineEnd == std::string::npos ? buffer.size() : lineEnd;
+	if (_state == State::REQUEST_LINE && _pos - _lineStart > _maxRequestLine)
+		throw ProcessingError(414, {}, "Request line is too long");
+	if (_state == State::HEADERS && _pos - _headersStart > _maxHeaderSize)
+		throw ProcessingError(431, {}, "Request headers are too large");
+	if (lineEnd == std::string::npos)
+		return false;
+	if (lineEnd == _lineStart || buffer[lineEnd - 1] != '\r')
+		throw ProcessingError(400, {}, "Request line does not end with CRLF");
+
+	line = std::string_view(buffer).substr(_lineStart, lineEnd - 1 - _lineStart);
+	_pos = lineEnd + 1;
+	_lineStart = _pos;
+	return true;
+}
+
+/* Only the headers which tell where the request ends and which server it is for are looked at here */
+void RequestParser::parseHeaderLine(std::string_view line)
+{
+	size_t colonPos = Scanner::find(line, ':');
+	if (colonPos == std::string_view::npos)
+		return ;
+	std::string_view name = Scanner::trim(line.substr(0, colonPos));
+	std::string_view value = Scanner::trim(line.substr(colonPos + 1));
+
+	if (equalsIgnoreCase(name, "content-length"))
+	{
+		size_t length = 0;
+		auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), length);
+		if (value.empty() || error != std::errc() || end != value.data() + value.size()
+			|| (_hasContentLength && length != _contentLength))
+			throw ProcessingError(400, {}, "Invalid Content-Length");
+		_contentLength = length;
+		_hasContentLength = true;
+	}
+	else if (equalsIgnoreCase(name, "transfer-encoding"))
+	{
+		// chunked is the last coding when it is used at all
+		_chunked = value.size() >= 7 && equalsIgnoreCase(value.substr(value.size() - 7), "chunked");
+	}
+	else if (equalsIgnoreCase(name, "host"))
+		_host = std::string(value);
+}
+
+/* Transfer-Encoding wins over Content-Length */
+void RequestParser::endHeaders()
+{
+	_headersEnd = _pos;
+	if (_chunked)
+	{
+		_contentLength = 0;
+		_state = State::CHUNKED_BODY;
+	}
+	else if (_contentLength > 0)
+		_state = State::BODY;
+	else
+		_state = State::DONE;
+}
+
+/**
+ * Getters
+ */
+
+RequestParser::State RequestParser::getState() const
+{
+	return _state;
+}
+
+bool RequestParser::isHeadersDone() const
+{
+	return _state > State::HEADERS;
+}
+
+size_t RequestParser::getHeadersEnd() const
+{
+	return _headersEnd;
+}
+
+/* End of the request in the buffer, valid once parse() returned true */
+size_t RequestParser::getRequestEnd() const
+{
+	return _pos;
+}
+
+/* Bytes of the body as they arrived, chunk sizes included */
+size_t RequestParser::getBodyBytes() const
+{
+	return _bodyBytes;
+}
+
+size_t RequestParser::getContentLength() const
+{
+	return _contentLength;
+}
+
+bool RequestParser::isChunked() const
+{
+	return _chunked;
+}
+
+const std::string& RequestParser::getHost() const
+{
+	return _host;
+}
+
+const std::map<std::string, std::string>& RequestParser::getTrailers() const
+{
+	return _decoder.getTrailers();
+}
+
+/* Decoded bytes are counted, a Content-Length over the limit is refused by the caller */
+void RequestParser::setMaxBodySize(size_t maxBodySize)
+{
+	_decoder.setMaxBodySize(maxBodySize);
+}
@@ -0,0 +1,82 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RequestParser.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/25 10:13:29 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "../utils/ServerException.hpp"
+#include "../utils/Scanner.hpp"
+#include "ChunkedDecoder.hpp"
+#include "RequestBody.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv> // std::from_chars()
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+
+/**
+ * Finds where a request ends while its bytes arrive. The parser keeps its
+ * place in the client's buffer, so every byte is looked at once however the
+ * request is split between reads. Body bytes are moved from the buffer to the
+ * body as they come, a chunked body through the ChunkedDecoder. A request line
+ * longer than _maxRequestLine is answered with 414, a header block longer than
+ * _maxHeaderSize with 431
+ */
+class RequestParser
+{
+	public:
+		enum class State
+		{
+			REQUEST_LINE,
+			HEADERS,
+			BODY,
+			CHUNKED_BODY,
+			DONE
+		};
+
+	private:
+		State						_state = State::REQUEST_LINE;
+		size_t						_pos = 0; // next byte of the buffer to look at
+		size_t						_lineStart = 0;
+		size_t						_headersStart = 0; // first byte after the request line
+		size_t						_headersEnd = 0; // where the body started, its bytes are not kept in the buffer
+		size_t						_contentLength = 0;
+		bool						_hasContentLength = false;
+		bool						_chunked = false;
+		size_t						_bodyBytes = 0; // as they arrived, chunk framing included
+		std::string					_host;
+		ChunkedDecoder				_decoder;
+
+		static constexpr size_t		_maxRequestLine = 8 * 1024;
+		static constexpr size_t		_maxHeaderSize = 32 * 1024;
+
+		bool						nextLine(const std::string& buffer, std::string_view& line);
+		void						parseHeaderLine(std::string_view line);
+		void						endHeaders();
+
+	public:
+		bool						parse(std::string& buffer, RequestBody& body);
+		void						reset();
+
+		/* Getters and setters */
+		State						getState() const;
+		bool						isHeadersDone() const;
+		size_t						getHeadersEnd() const;
+		size_t						getRequestEnd() const;
+		size_t						getBodyBytes() const;
+		size_t						getContentLength() const;
+		bool						isChunked() const;
+		const std::string&			getHost() const;
+		const std::map<std::string, std::string>&	getTrailers() const;
+		void						setMaxBodySize(size_t maxBodySize);
+};
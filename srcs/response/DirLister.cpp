@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/11 23:15:53 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/13 10:48:51 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/08/21 16:12:40 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -61,7 +61,9 @@ std::stringstream DirLister::generateDirectoryListingHtml(const std::string& roo
 			htmlStream << "/"; 
 		htmlStream << "</a></div>\n";
 		// Output last write time
-		htmlStream << "<div class=\"file-cell date\">" << std::put_time(std::localtime(&cftime), "%d-%b-%Y %T") << "</div>";
+		std::tm lastWriteTm;
+		localtime_r(&cftime, &lastWriteTm);
+		htmlStream << "<div class=\"file-cell date\">" << std::put_time(&lastWriteTm, "%d-%b-%Y %T") << "</div>";
 		// Output size
 		htmlStream << "<div class=\"file-cell size\">";
 		htmlStream << (!entry.is_directory() ? std::to_string(fs::file_size(filePath)) : "-");
@@ -0,0 +1,48 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileBody.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/04 11:47:26 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/18 09:37:52 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FileBody.hpp"
+
+FileBody::FileBody(int fd, size_t size) : _fd(fd), _size(size) {}
+
+FileBody::~FileBody()
+{
+	close(_fd);
+}
+
+/* The size is taken from the open fd, so it matches the file the body is sent from */
+std::shared_ptr<FileBody> FileBody::open(const std::string& filePath)
+{
+	int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		throw ProcessingError(500, {}, "Exception has been thrown in open() method of FileBody class");
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) == -1)
+	{
+		close(fd);
+		throw ProcessingError(500, {}, "Exception has been thrown in open() method of FileBody class");
+	}
+	// Bodies are read front to back, the kernel may read further ahead and drop pages behind
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return std::make_shared<FileBody>(fd, static_cast<size_t>(fileStat.st_size));
+}
+
+int FileBody::getFd() const
+{
+	return _fd;
+}
+
+size_t FileBody::getSize() const
+{
+	return _size;
+}
@@ -0,0 +1,40 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileBody.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/04 11:47:26 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/18 09:37:52 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "../utils/ServerException.hpp"
+#include <memory>
+#include <string>
+#include <fcntl.h> // open(), posix_fadvise()
+#include <sys/stat.h> // fstat()
+#include <unistd.h> // close()
+
+/* An open file sent as a response body, shared by the responses and chains holding it and closed with the last of them */
+class FileBody
+{
+	private:
+		int									_fd;
+		size_t								_size;
+
+	public:
+		FileBody(int fd, size_t size);
+		~FileBody();
+
+		FileBody(const FileBody&) = delete;
+		FileBody& operator=(const FileBody&) = delete;
+
+		static std::shared_ptr<FileBody>	open(const std::string& filePath);
+
+		int									getFd() const;
+		size_t								getSize() const;
+};
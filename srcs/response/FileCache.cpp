@@ -0,0 +1,338 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileCache.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/06 16:21:50 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/13 10:52:38 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FileCache.hpp"
+#include "Response.hpp"
+
+std::mutex										FileCache::_mutex;
+bool											FileCache::_initialized = false;
+int												FileCache::_inotifyFd = -1;
+size_t											FileCache::_capacity = 0;
+size_t											FileCache::_size = 0;
+size_t											FileCache::_generation = 0;
+std::unordered_map<std::string, FileCache::Slot>	FileCache::_slots;
+std::list<std::string>							FileCache::_lru;
+std::unordered_map<int, std::string>			FileCache::_watchedDirs;
+std::unordered_map<std::string, int>			FileCache::_dirWatches;
+FileCache::Stats								FileCache::_stats;
+
+/**
+ * Called by every event loop of the process, the first call sets the cache up.
+ * Without inotify the entries could not be invalidated, the cache stays off
+ */
+void FileCache::init(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_initialized)
+		return ;
+	_initialized = true;
+	if (capacity == 0)
+	{
+		LOG_INFO("File cache is off");
+		return ;
+	}
+	_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_inotifyFd == -1)
+	{
+		LOG_WARNING("inotify_init1() failed: ", strerror(errno), ", file cache is off");
+		return ;
+	}
+	_capacity = capacity;
+	LOG_INFO("File cache size: ", _capacity, " bytes");
+}
+
+int FileCache::getInotifyFd()
+{
+	return _inotifyFd;
+}
+
+/* Lexically normalized, so one file gets one key whatever the request path looked like */
+std::string FileCache::normalize(const std::string& path)
+{
+	std::string normalized = std::filesystem::path(path).lexically_normal().string();
+
+	if (normalized.size() > 1 && normalized.back() == '/')
+		normalized.pop_back();
+	return normalized;
+}
+
+/* A path never holds a NUL byte, the variant key can not be the key of another file */
+std::string FileCache::gzipKey(const std::string& key)
+{
+	return key + std::string(1, '\0') + "gzip";
+}
+
+void FileCache::watchDirectory(const std::string& directory)
+{
+	if (_capacity == 0)
+		return ;
+	std::lock_guard<std::mutex> lock(_mutex);
+	watch(normalize(directory));
+}
+
+/* Returns false when the directory can not be watched, its files are then not cached */
+bool FileCache::watch(const std::string& directory)
+{
+	if (_dirWatches.find(directory) != _dirWatches.end())
+		return true;
+	int wd = inotify_add_watch(_inotifyFd, directory.c_str(), _watchMask);
+	if (wd == -1)
+	{
+		LOG_DEBUG("inotify_add_watch() failed for ", directory, ": ", strerror(errno));
+		return false;
+	}
+	_dirWatches[directory] = wd;
+	_watchedDirs[wd] = directory;
+	return true;
+}
+
+/* Cached entry of the file or nullptr, the file is not read on a miss */
+std::shared_ptr<const FileCache::Entry> FileCache::find(const std::string& filePath)
+{
+	if (_capacity == 0)
+		return nullptr;
+	std::string key = normalize(filePath);
+	std::lock_guard<std::mutex> lock(_mutex);
+	return lookup(key);
+}
+
+std::shared_ptr<const FileCache::Entry> FileCache::lookup(const std::string& key)
+{
+	auto slot = _slots.find(key);
+
+	if (slot == _slots.end())
+		return nullptr;
+	_lru.splice(_lru.begin(), _lru, slot->second.lruPosition);
+	_stats.hits++;
+	return slot->second.entry;
+}
+
+/**
+ * Cached entry of the file, read from disk on a miss. A file which is larger
+ * than the cache or which may have changed while it was read is returned
+ * without being cached. Returns nullptr when the cache is off or the path is
+ * not a readable regular file
+ */
+std::shared_ptr<const FileCache::Entry> FileCache::load(const std::string& filePath)
+{
+	if (_capacity == 0)
+		return nullptr;
+	std::string key = normalize(filePath);
+	size_t generation;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::shared_ptr<const Entry> entry = lookup(key);
+		if (entry)
+			return entry;
+		_stats.misses++;
+		// Watching before reading makes any later change evict the entry
+		if (!watch(std::filesystem::path(key).parent_path().string()))
+			return nullptr;
+		generation = _generation;
+	}
+
+	std::shared_ptr<const Entry> entry = readEntry(filePath);
+	if (!entry)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	// An event handled by another thread while the file was read may have been about this file
+	if (generation == _generation && entry->content->size() <= _capacity)
+		insert(key, entry);
+	return entry;
+}
+
+/**
+ * Watches the directory of the file before it is compressed, and returns the
+ * generation to pass to storeGzip(). A change of the file in the meantime
+ * keeps the variant out of the cache
+ */
+size_t FileCache::prepareGzip(const std::string& filePath)
+{
+	if (_capacity == 0)
+		return 0;
+	std::lock_guard<std::mutex> lock(_mutex);
+	watch(std::filesystem::path(normalize(filePath)).parent_path().string());
+	return _generation;
+}
+
+/* Cached gzip variant of the version of the file last modified at `modified`, or nullptr */
+std::shared_ptr<const FileCache::Entry> FileCache::findGzip(const std::string& filePath, time_t modified)
+{
+	if (_capacity == 0)
+		return nullptr;
+	std::string key = gzipKey(normalize(filePath));
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto slot = _slots.find(key);
+	if (slot == _slots.end() || slot->second.entry->modified != modified)
+		return nullptr;
+	return lookup(key);
+}
+
+void FileCache::storeGzip(const std::string& filePath, std::shared_ptr<const Entry> entry, size_t generation)
+{
+	if (_capacity == 0)
+		return ;
+	std::string key = normalize(filePath);
+	std::lock_guard<std::mutex> lock(_mutex);
+	// Without a watch on its directory the variant could not be dropped when the file changes
+	if (generation == _generation && entry->content->size() <= _capacity
+		&& _dirWatches.count(std::filesystem::path(key).parent_path().string()) > 0)
+		insert(gzipKey(key), std::move(entry));
+}
+
+std::shared_ptr<const FileCache::Entry> FileCache::readEntry(const std::string& filePath)
+{
+	int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return nullptr;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) == -1 || !S_ISREG(fileStat.st_mode))
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	std::string content(fileStat.st_size, '\0');
+	size_t total = 0;
+	while (total < content.size())
+	{
+		ssize_t bytesRead = read(fd, content.data() + total, content.size() - total);
+		if (bytesRead <= 0)
+			break ;
+		total += bytesRead;
+	}
+	close(fd);
+	// A file truncated while it was read is cached as it was read, its inotify event drops it
+	content.resize(total);
+
+	std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+	entry->content = std::make_shared<const std::string>(std::move(content));
+	entry->type = Response::findType(filePath);
+
+	entry->etag = Response::makeETag(fileStat);
+	entry->lastModified = Utility::getDate(fileStat.st_mtime);
+	entry->modified = fileStat.st_mtime;
+	return entry;
+}
+
+/* Least recently used entries are evicted until the new one fits */
+void FileCache::insert(const std::string& key, std::shared_ptr<const Entry> entry)
+{
+	erase(key);
+	while (!_lru.empty() && _size + entry->content->size() > _capacity)
+	{
+		std::string oldest = _lru.back();
+		erase(oldest);
+		_stats.evictions++;
+	}
+	_lru.push_front(key);
+	_size += entry->content->size();
+	_slots[key] = {std::move(entry), _lru.begin()};
+}
+
+/* Returns false when there was no entry for the key */
+bool FileCache::erase(const std::string& key)
+{
+	auto slot = _slots.find(key);
+
+	if (slot == _slots.end())
+		return false;
+	_size -= slot->second.entry->content->size();
+	_lru.erase(slot->second.lruPosition);
+	_slots.erase(slot);
+	return true;
+}
+
+/* Drops the entry of the path, and of everything below it for a directory */
+void FileCache::invalidate(const std::string& path, bool withChildren)
+{
+	if (erase(path))
+		_stats.invalidations++;
+	if (erase(gzipKey(path)))
+		_stats.invalidations++;
+	if (!withChildren)
+		return ;
+
+	std::string prefix = path + "/";
+	for (auto slot = _slots.begin(); slot != _slots.end();)
+	{
+		std::string key = (slot++)->first;
+		if (key.compare(0, prefix.size(), prefix) == 0 && erase(key))
+			_stats.invalidations++;
+	}
+}
+
+/* Drains the inotify fd, every event drops the entries of the path it names */
+void FileCache::handleEvents()
+{
+	alignas(struct inotify_event) char buffer[4096];
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	ssize_t length;
+	while ((length = read(_inotifyFd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char* position = buffer; position < buffer + length;)
+		{
+			const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(position);
+			position += sizeof(struct inotify_event) + event->len;
+			_generation++;
+
+			// Events were lost, any entry may be stale
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				LOG_WARNING("inotify queue overflowed, file cache is cleared");
+				_stats.invalidations += _slots.size();
+				_slots.clear();
+				_lru.clear();
+				_size = 0;
+				continue ;
+			}
+			auto directory = _watchedDirs.find(event->wd);
+			if (directory == _watchedDirs.end())
+				continue ;
+			if (event->len > 0)
+				invalidate((std::filesystem::path(directory->second) / event->name).string(), event->mask & IN_ISDIR);
+			// A moved directory keeps its watch under the old path, it is dropped and watched again on the next miss
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+			{
+				invalidate(directory->second, true);
+				if (event->mask & IN_MOVE_SELF)
+					inotify_rm_watch(_inotifyFd, event->wd);
+				_dirWatches.erase(directory->second);
+				_watchedDirs.erase(directory);
+			}
+		}
+	}
+}
+
+FileCache::Stats FileCache::getStats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Stats stats = _stats;
+
+	stats.entries = _slots.size();
+	stats.bytes = _size;
+	return stats;
+}
+
+void FileCache::logStats()
+{
+	if (_capacity == 0)
+		return ;
+	Stats stats = getStats();
+	LOG_INFO("File cache: ", stats.entries, " files, ", stats.bytes, " bytes");
+	LOG_INFO("File cache hits: ", stats.hits, ", misses: ", stats.misses,
+		", evictions: ", stats.evictions, ", invalidations: ", stats.invalidations);
+}
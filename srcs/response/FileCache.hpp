@@ -0,0 +1,104 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileCache.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/06 16:21:50 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/13 10:52:38 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include "../utils/logUtils.hpp"
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cerrno>
+#include <cstring> // strerror()
+#include <ctime>
+#include <fcntl.h> // open()
+#include <sys/inotify.h>
+#include <sys/stat.h> // fstat()
+#include <unistd.h> // read(), close()
+
+/**
+ * Contents and metadata of small static files, shared by all the event loop
+ * threads of a process. Buffers are handed to responses by reference, an
+ * evicted entry lives on until the last response holding it is written.
+ * Entries are dropped on inotify events from the directories they were read
+ * from, and the least recently used ones go first when the cache is full.
+ * The gzip variant of a file is an entry of its own, dropped with the file
+ */
+class FileCache
+{
+	public:
+		struct Entry
+		{
+			std::shared_ptr<const std::string>	content;
+			std::string							type;
+			std::string							etag; // from inode, size and mtime
+			std::string							lastModified; // HTTP date of mtime
+			time_t								modified;
+		};
+
+		struct Stats
+		{
+			size_t								hits = 0;
+			size_t								misses = 0;
+			size_t								evictions = 0; // dropped to make room
+			size_t								invalidations = 0; // dropped on inotify events
+			size_t								entries = 0;
+			size_t								bytes = 0;
+		};
+
+	private:
+		struct Slot
+		{
+			std::shared_ptr<const Entry>		entry;
+			std::list<std::string>::iterator	lruPosition;
+		};
+
+		static constexpr uint32_t				_watchMask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE
+			| IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+		static std::mutex						_mutex;
+		static bool								_initialized;
+		static int								_inotifyFd;
+		static size_t							_capacity;
+		static size_t							_size;
+		static size_t							_generation; // bumped by every inotify event
+		static std::unordered_map<std::string, Slot>	_slots; // keyed by normalized path
+		static std::list<std::string>			_lru; // most recently used first
+		static std::unordered_map<int, std::string>		_watchedDirs; // watch descriptor -> directory
+		static std::unordered_map<std::string, int>		_dirWatches;
+		static Stats							_stats;
+
+		static std::string						normalize(const std::string& path);
+		static std::string						gzipKey(const std::string& key);
+		static std::shared_ptr<const Entry>		lookup(const std::string& key);
+		static bool								watch(const std::string& directory);
+		static void								insert(const std::string& key, std::shared_ptr<const Entry> entry);
+		static bool								erase(const std::string& key);
+		static void								invalidate(const std::string& path, bool withChildren);
+		static std::shared_ptr<const Entry>		readEntry(const std::string& filePath);
+
+	public:
+		static void								init(size_t capacity);
+		static int								getInotifyFd();
+		static void								watchDirectory(const std::string& directory);
+		static std::shared_ptr<const Entry>		find(const std::string& filePath);
+		static std::shared_ptr<const Entry>		load(const std::string& filePath);
+		static size_t							prepareGzip(const std::string& filePath);
+		static std::shared_ptr<const Entry>		findGzip(const std::string& filePath, time_t modified);
+		static void								storeGzip(const std::string& filePath, std::shared_ptr<const Entry> entry,
+													size_t generation);
+		static void								handleEvents();
+		static Stats							getStats();
+		static void								logStats();
+};
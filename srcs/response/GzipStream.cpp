@@ -0,0 +1,87 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   GzipStream.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/11 15:06:44 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/11 15:06:44 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#include "GzipStream.hpp"
+
+/* windowBits 15 + 16 asks zlib for a gzip header and trailer instead of a zlib one */
+GzipStream::GzipStream(int level)
+{
+	if (deflateInit2(&_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw ProcessingError(500, {}, "Exception has been thrown in GzipStream() constructor of GzipStream class");
+}
+
+GzipStream::~GzipStream()
+{
+	deflateEnd(&_stream);
+}
+
+void GzipStream::update(const char* data, size_t size, std::string& output)
+{
+	_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	_stream.avail_in = static_cast<uInt>(size);
+	deflateInto(Z_NO_FLUSH, output);
+}
+
+/* Flushes what deflate still holds and writes the gzip trailer */
+void GzipStream::finish(std::string& output)
+{
+	_stream.next_in = nullptr;
+	_stream.avail_in = 0;
+	deflateInto(Z_FINISH, output);
+}
+
+/* Runs deflate until it has taken all the input, or until the end of the stream on Z_FINISH */
+void GzipStream::deflateInto(int flush, std::string& output)
+{
+	int ret;
+
+	do
+	{
+		size_t used = output.size();
+		output.resize(used + _chunkSize);
+		_stream.next_out = reinterpret_cast<Bytef*>(output.data() + used);
+		_stream.avail_out = static_cast<uInt>(_chunkSize);
+		ret = deflate(&_stream, flush);
+		output.resize(used + _chunkSize - _stream.avail_out);
+		if (ret == Z_STREAM_ERROR)
+			throw ProcessingError(500, {}, "Exception has been thrown in deflateInto() method of GzipStream class");
+	} while (_stream.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+}
+
+std::string GzipStream::compress(const std::string& data, int level)
+{
+	GzipStream gzip(level);
+	std::string output;
+
+	output.reserve(data.size() / 2);
+	gzip.update(data.data(), data.size(), output);
+	gzip.finish(output);
+	return output;
+}
+
+/* Reads the file in chunks from its start, the fd's own offset is not moved */
+std::string GzipStream::compressFile(int fd, size_t size, int level)
+{
+	GzipStream gzip(level);
+	std::vector<char> input(_chunkSize);
+	std::string output;
+
+	for (size_t offset = 0; offset < size;)
+	{
+		ssize_t bytesRead = pread(fd, input.data(), std::min(input.size(), size - offset), offset);
+		if (bytesRead <= 0)
+			throw ProcessingError(500, {}, "Exception has been thrown in compressFile() method of GzipStream class");
+		gzip.update(input.data(), bytesRead, output);
+		offset += bytesRead;
+	}
+	gzip.finish(output);
+	return output;
+}
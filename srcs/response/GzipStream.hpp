@@ -0,0 +1,47 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   GzipStream.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/11 15:06:44 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/11 15:06:44 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#pragma once
+
+#include "../utils/ServerException.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unistd.h> // pread()
+#include <zlib.h>
+
+/**
+ * Deflate stream with a gzip wrapper. The input is fed in pieces and the
+ * compressed bytes are appended to the caller's buffer, a body is never held
+ * whole before it is compressed
+ */
+class GzipStream
+{
+	private:
+		z_stream					_stream = {};
+
+		static constexpr size_t		_chunkSize = 64 * 1024;
+
+		void						deflateInto(int flush, std::string& output);
+
+	public:
+		GzipStream(int level);
+		~GzipStream();
+
+		GzipStream(const GzipStream&) = delete;
+		GzipStream& operator=(const GzipStream&) = delete;
+
+		void						update(const char* data, size_t size, std::string& output);
+		void						finish(std::string& output);
+
+		static std::string			compress(const std::string& data, int level);
+		static std::string			compressFile(int fd, size_t size, int level);
+};
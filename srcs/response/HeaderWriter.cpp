@@ -0,0 +1,80 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   HeaderWriter.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/20 14:44:10 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/20 14:44:10 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#include "HeaderWriter.hpp"
+
+/* Starts the block with the status line of the code */
+HeaderWriter::HeaderWriter(int code)
+{
+	_buffer.reserve(_reserved);
+	_buffer.append(statusLine(code));
+}
+
+void HeaderWriter::add(std::string_view key, std::string_view value)
+{
+	_buffer.append(key);
+	_buffer.append(": ");
+	_buffer.append(value);
+	_buffer.append("\r\n");
+}
+
+void HeaderWriter::add(std::string_view key, uint64_t value)
+{
+	char digits[20];
+	auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+
+	(void)error;
+	add(key, std::string_view(digits, end - digits));
+}
+
+/* Closes the block with the empty line, the writer is left empty */
+std::string HeaderWriter::finish()
+{
+	_buffer.append("\r\n");
+	return std::move(_buffer);
+}
+
+/* Throws std::out_of_range for a code missing from the table, as std::map::at() did */
+std::string_view HeaderWriter::statusLine(int code)
+{
+	for (const auto& [statusCode, line] : _statusLines)
+	{
+		if (statusCode == code)
+			return line;
+	}
+	throw std::out_of_range("No status line for code " + std::to_string(code));
+}
+
+/* The status of the status line, e.g. "404 Not Found" */
+std::string_view HeaderWriter::status(int code)
+{
+	std::string_view line = statusLine(code);
+
+	return line.substr(9, line.size() - 11);
+}
+
+/* The HTTP date is made again only when the second changes */
+std::string_view HeaderWriter::date()
+{
+	thread_local time_t		cachedSecond = -1;
+	thread_local char		cachedDate[32];
+	thread_local size_t		cachedLength = 0;
+	time_t					now = time(nullptr);
+
+	if (now != cachedSecond)
+	{
+		struct tm timeinfo;
+		gmtime_r(&now, &timeinfo);
+		cachedLength = strftime(cachedDate, sizeof(cachedDate), "%a, %d %b %Y %H:%M:%S GMT", &timeinfo);
+		cachedSecond = now;
+	}
+	return std::string_view(cachedDate, cachedLength);
+}
@@ -0,0 +1,123 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   HeaderWriter.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/20 14:44:10 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/25 10:13:29 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#pragma once
+
+#include <charconv> // std::to_chars()
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/**
+ * Writes a response header block into one buffer reserved up front. Status
+ * lines and MIME types come from constant tables and the Date value is made
+ * once per second per thread, a header block costs no allocation besides its
+ * own buffer
+ */
+class HeaderWriter
+{
+	private:
+		std::string									_buffer;
+
+		static constexpr size_t						_reserved = 512;
+
+		// https://developer.mozilla.org/en-US/docs/Web/HTTP/Status
+		static constexpr std::pair<int, std::string_view>	_statusLines[] = {
+			{200, "HTTP/1.1 200 OK\r\n"},
+			{201, "HTTP/1.1 201 Created\r\n"},
+			{204, "HTTP/1.1 204 No Content\r\n"},
+			{206, "HTTP/1.1 206 Partial Content\r\n"},
+			{304, "HTTP/1.1 304 Not Modified\r\n"},
+			{307, "HTTP/1.1 307 Temporary Redirect\r\n"},
+			{400, "HTTP/1.1 400 Bad Request\r\n"},
+			{403, "HTTP/1.1 403 Forbidden\r\n"},
+			{404, "HTTP/1.1 404 Not Found\r\n"},
+			{405, "HTTP/1.1 405 Method Not Allowed\r\n"}, // if the location does not allowes method in request. Then put "Allowed: GET, POST" in response header
+			{411, "HTTP/1.1 411 Length Required\r\n"}, // Content-Length not provided
+			{413, "HTTP/1.1 413 Payload Too Large\r\n"}, // if the request body size exceeds the clientMaxBodySize
+			{414, "HTTP/1.1 414 URI Too Long\r\n"}, // the request line is longer than the parser accepts
+			{416, "HTTP/1.1 416 Range Not Satisfiable\r\n"}, // no range of the Range header overlaps the file
+			{431, "HTTP/1.1 431 Request Header Fields Too Large\r\n"}, // the header block is longer than the parser accepts
+			{500, "HTTP/1.1 500 Internal Server Error\r\n"}, // can be used when the server runs into unexpected issues processing the request, including memory allocation failures
+			{502, "HTTP/1.1 502 Bad Gateway\r\n"},
+			{504, "HTTP/1.1 504 Gateway Timeout\r\n"},
+			{505, "HTTP/1.1 505 HTTP Version Not Supported\r\n"}
+		};
+
+		static constexpr std::pair<std::string_view, std::string_view>	_mimeTypes[] = {
+			{"html", "text/html; charset=UTF-8"},
+			{"htm", "text/html; charset=UTF-8"},
+			{"css", "text/css; charset=UTF-8"},
+			{"js", "application/javascript; charset=UTF-8"},
+
+			{"ttf", "font/ttf"},
+			{"woff", "font/woff"},
+			{"woff2", "font/woff2"},
+
+			{"jpg", "image/jpeg"},
+			{"jpeg", "image/jpeg"},
+			{"png", "image/png"},
+			{"gif", "image/gif"},
+			{"svg", "image/svg+xml"},
+			{"ico",	"image/x-icon"},
+			{"bmp", "image/bmp"},
+			{"tiff", "image/tiff"},
+			{"webp", "image/webp"},
+
+			{"mp3", "audio/mpeg"},
+			{"wav", "audio/wav"},
+			{"ogg", "audio/ogg"},
+
+			{"mp4", "video/mp4"},
+			{"webm", "video/webm"},
+
+			{"txt", "text/plain; charset=UTF-8"},
+			{"sitemap", "application/xml; charset=UTF-8"},
+			{"json", "application/json; charset=UTF-8"},
+			{"xml", "application/xml; charset=UTF-8"},
+			{"csv", "text/csv; charset=UTF-8"},
+			{"markdown", "text/markdown; charset=UTF-8"},
+			{"pdf", "application/pdf"},
+			{"zip", "application/zip"},
+			{"gzip", "application/gzip"}
+		};
+
+	public:
+		// https://stackoverflow.com/questions/20508788/do-i-need-content-type-application-octet-stream-for-file-download
+		static constexpr std::string_view			defaultMimeType = "application/octet-stream";
+
+		HeaderWriter(int code);
+
+		void										add(std::string_view key, std::string_view value);
+		void										add(std::string_view key, uint64_t value);
+		std::string									finish();
+
+		static std::string_view						statusLine(int code);
+		static std::string_view						status(int code);
+		static std::string_view						date();
+
+		/* MIME type of a file extension, resolved at compile time for a constant extension */
+		static constexpr std::string_view			mimeType(std::string_view extension)
+		{
+			for (const auto& [format, type] : _mimeTypes)
+			{
+				if (format == extension)
+					return type;
+			}
+			return defaultMimeType;
+		}
+};
+
+static_assert(HeaderWriter::mimeType("css") == "text/css; charset=UTF-8");
+static_assert(HeaderWriter::mimeType("unknown") == HeaderWriter::defaultMimeType);
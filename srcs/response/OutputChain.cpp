@@ -0,0 +1,142 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   OutputChain.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/02 14:08:31 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/04 09:48:23 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "OutputChain.hpp"
+
+void OutputChain::append(std::string data)
+{
+	if (!data.empty())
+		append(std::make_shared<const std::string>(std::move(data)));
+}
+
+void OutputChain::append(std::shared_ptr<const std::string> buffer)
+{
+	if (!buffer || buffer->empty())
+		return ;
+	size_t length = buffer->size();
+	_size += length;
+	_segments.push_back({std::move(buffer), nullptr, 0, length, 0});
+}
+
+/* A part of a shared buffer, e.g. one range of a cached file */
+void OutputChain::append(std::shared_ptr<const std::string> buffer, size_t offset, size_t length)
+{
+	if (!buffer || length == 0)
+		return ;
+	_size += length;
+	_segments.push_back({std::move(buffer), nullptr, offset, length, 0});
+}
+
+void OutputChain::append(std::shared_ptr<FileBody> file, size_t offset, size_t length)
+{
+	if (!file || length == 0)
+		return ;
+	_size += length;
+	_segments.push_back({nullptr, std::move(file), offset, length, offset});
+}
+
+/* Writes at most maxBytes from the head of the chain in one send of the event loop, returns what it returned */
+ssize_t OutputChain::writeTo(EventLoop& loop, int fd, size_t maxBytes)
+{
+	if (_segments.empty())
+		return 0;
+	if (_segments.front().file)
+		return writeFile(loop, fd, maxBytes);
+	return writeBuffers(loop, fd, maxBytes);
+}
+
+/* Takes the buffers up to the first file range */
+ssize_t OutputChain::writeBuffers(EventLoop& loop, int fd, size_t maxBytes)
+{
+	struct iovec			iov[_maxSegments];
+	EventLoop::SendBuffers	buffers;
+	int						count = 0;
+	size_t					total = 0;
+
+	for (auto it = _segments.begin(); it != _segments.end() && !it->file
+		&& count < _maxSegments && total < maxBytes; ++it)
+	{
+		size_t length = std::min(it->length, maxBytes - total);
+		iov[count].iov_base = const_cast<char*>(it->buffer->data() + it->offset);
+		iov[count].iov_len = length;
+		buffers.push_back(it->buffer);
+		total += length;
+		count++;
+	}
+	ssize_t written = loop.send(fd, iov, count, std::move(buffers));
+	if (written > 0)
+		consume(written);
+	return written;
+}
+
+/**
+ * The file offset is kept in the segment, the fd's own offset is never moved.
+ * Once half of the window asked for last time is sent, the next window of the
+ * range is asked for, so the disk reads ahead of the socket
+ */
+ssize_t OutputChain::writeFile(EventLoop& loop, int fd, size_t maxBytes)
+{
+	Segment&	head = _segments.front();
+	off_t		offset = static_cast<off_t>(head.offset);
+
+	head.advisedEnd = std::max(head.advisedEnd, head.offset);
+	if (head.offset + _readaheadWindow / 2 >= head.advisedEnd && head.advisedEnd < head.offset + head.length)
+	{
+		size_t advised = std::min(_readaheadWindow, head.offset + head.length - head.advisedEnd);
+		posix_fadvise(head.file->getFd(), head.advisedEnd, advised, POSIX_FADV_WILLNEED);
+		head.advisedEnd += advised;
+	}
+
+	ssize_t written = loop.sendFile(fd, head.file->getFd(), &offset, std::min(head.length, maxBytes));
+	if (written > 0)
+		consume(written);
+	// The file got shorter than the announced Content-Length, the response can not be completed
+	if (written == 0)
+	{
+		errno = EIO;
+		return -1;
+	}
+	return written;
+}
+
+void OutputChain::consume(size_t bytes)
+{
+	_size -= bytes;
+	while (bytes > 0)
+	{
+		Segment& head = _segments.front();
+		if (bytes < head.length)
+		{
+			head.offset += bytes;
+			head.length -= bytes;
+			return ;
+		}
+		bytes -= head.length;
+		_segments.pop_front();
+	}
+}
+
+void OutputChain::clear()
+{
+	_segments.clear();
+	_size = 0;
+}
+
+size_t OutputChain::size() const
+{
+	return _size;
+}
+
+bool OutputChain::empty() const
+{
+	return _size == 0;
+}
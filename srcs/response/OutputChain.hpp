@@ -0,0 +1,69 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   OutputChain.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/02 14:08:31 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/10/04 09:48:23 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include <algorithm> // std::min()
+#include <deque>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h> // writev()
+#include <sys/sendfile.h> // sendfile()
+#include <fcntl.h> // posix_fadvise()
+#include <cerrno>
+
+#include "FileBody.hpp"
+#include "../network/EventLoop.hpp"
+
+/**
+ * Bytes of the responses waiting on a connection, kept as a list of buffers
+ * and file ranges. Header blocks are owned by the chain, bodies are shared
+ * with the Response they come from, so nothing is copied before it reaches
+ * the socket. The buffers in front of a file range leave in one writev(),
+ * the file range itself goes out with sendfile() on the next calls. Both go
+ * through the event loop, which may run them as io_uring requests holding
+ * the shared buffers until the kernel sent them
+ */
+class OutputChain
+{
+	private:
+		struct Segment
+		{
+			std::shared_ptr<const std::string>	buffer; // nullptr for a file range
+			std::shared_ptr<FileBody>			file;
+			size_t								offset;
+			size_t								length;
+			size_t								advisedEnd; // file offset the readahead was asked up to
+		};
+
+		static constexpr int				_maxSegments = 64;
+		static constexpr size_t				_readaheadWindow = 1024 * 1024;
+
+		std::deque<Segment>					_segments;
+		size_t								_size = 0;
+
+		void								consume(size_t bytes);
+		ssize_t								writeBuffers(EventLoop& loop, int fd, size_t maxBytes);
+		ssize_t								writeFile(EventLoop& loop, int fd, size_t maxBytes);
+
+	public:
+		void								append(std::string data);
+		void								append(std::shared_ptr<const std::string> buffer);
+		void								append(std::shared_ptr<const std::string> buffer, size_t offset, size_t length);
+		void								append(std::shared_ptr<FileBody> file, size_t offset, size_t length);
+		ssize_t								writeTo(EventLoop& loop, int fd, size_t maxBytes);
+		void								clear();
+
+		size_t								size() const;
+		bool								empty() const;
+};
@@ -0,0 +1,174 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Precompressor.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/09 13:42:17 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/11 15:06:44 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#include "Precompressor.hpp"
+
+/* The files are split between one thread per online CPU */
+int Precompressor::run(const std::string& configFile, const char* argv0)
+{
+	Config config(configFile, argv0);
+	std::vector<std::string> files = collectFiles(config);
+
+	std::atomic<size_t> next(0);
+	std::atomic<size_t> compressed(0);
+	std::atomic<size_t> upToDate(0);
+	std::atomic<size_t> notSmaller(0);
+	std::atomic<size_t> failed(0);
+	std::atomic<size_t> totalIn(0);
+	std::atomic<size_t> totalOut(0);
+
+	auto worker = [&]()
+	{
+		for (size_t i = next++; i < files.size(); i = next++)
+		{
+			size_t bytesIn = 0;
+			size_t bytesOut = 0;
+			switch (compressFile(files[i], bytesIn, bytesOut))
+			{
+				case Result::COMPRESSED:
+					compressed++;
+					totalIn += bytesIn;
+					totalOut += bytesOut;
+					break ;
+				case Result::UP_TO_DATE:
+					upToDate++;
+					break ;
+				case Result::NOT_SMALLER:
+					notSmaller++;
+					break ;
+				case Result::FAILED:
+					failed++;
+					break ;
+			}
+		}
+	};
+
+	size_t threadsNum = std::min(static_cast<size_t>(Utility::countOnlineCpus()), std::max(files.size(), size_t(1)));
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < threadsNum; i++)
+		threads.emplace_back(worker);
+	for (std::thread& thread : threads)
+		thread.join();
+
+	LOG_INFO("Precompressed ", compressed.load(), " of ", files.size(), " file(s) with ", threadsNum, " thread(s)");
+	LOG_INFO("Compressed ", totalIn.load(), " bytes to ", totalOut.load(), " bytes");
+	LOG_INFO("Up to date: ", upToDate.load(), ", not smaller when compressed: ", notSmaller.load(),
+		", failed: ", failed.load());
+	return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* A directory shared by several locations is walked once */
+std::vector<std::string> Precompressor::collectFiles(const Config& config)
+{
+	std::set<std::string> roots;
+	for (auto& [key, serverConfigs] : config.getServersConfigsMap())
+	{
+		for (const ServerConfig& serverConfig : serverConfigs)
+		{
+			for (const Location& location : serverConfig.locations)
+			{
+				if (!location.root.empty())
+					roots.insert(location.root);
+			}
+		}
+	}
+
+	std::set<std::string> files;
+	for (const std::string& root : roots)
+	{
+		std::error_code ec;
+		fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+		if (ec)
+		{
+			LOG_WARNING("Precompressor: can not walk ", root, ": ", ec.message());
+			continue ;
+		}
+		for (; it != fs::recursive_directory_iterator(); it.increment(ec))
+		{
+			if (it->is_regular_file(ec) && Response::isPrecompressible(it->path().string()))
+				files.insert(it->path().lexically_normal().string());
+		}
+	}
+	return std::vector<std::string>(files.begin(), files.end());
+}
+
+/**
+ * The gzip file is written next to a temporary name and renamed over the old
+ * one, a running server never reads half of it. A sibling not older than the
+ * file is kept
+ */
+Precompressor::Result Precompressor::compressFile(const std::string& filePath, size_t& bytesIn, size_t& bytesOut)
+{
+	std::string gzipPath = filePath + ".gz";
+	std::string tmpPath = gzipPath + ".tmp";
+	struct stat fileStat;
+	struct stat gzipStat;
+
+	if (stat(filePath.c_str(), &fileStat) == -1)
+		return Result::FAILED;
+	if (stat(gzipPath.c_str(), &gzipStat) == 0 && gzipStat.st_mtime >= fileStat.st_mtime)
+		return Result::UP_TO_DATE;
+
+	std::ifstream in(filePath, std::ios::binary);
+	std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+	bool deflated = false;
+	try
+	{
+		deflated = in && out && deflateFile(in, out, bytesOut);
+	}
+	catch (const ProcessingError& e)
+	{
+		LOG_DEBUG("Precompressor: ", e.what());
+	}
+	if (!deflated)
+	{
+		LOG_WARNING("Precompressor: failed to compress ", filePath);
+		std::remove(tmpPath.c_str());
+		return Result::FAILED;
+	}
+	out.close();
+	bytesIn = fileStat.st_size;
+	if (bytesOut >= bytesIn)
+	{
+		std::remove(tmpPath.c_str());
+		return Result::NOT_SMALLER;
+	}
+	if (std::rename(tmpPath.c_str(), gzipPath.c_str()) == -1)
+	{
+		LOG_WARNING("Precompressor: failed to rename ", tmpPath, ": ", strerror(errno));
+		std::remove(tmpPath.c_str());
+		return Result::FAILED;
+	}
+	LOG_DEBUG("Precompressor: ", filePath, " ", bytesIn, " -> ", bytesOut);
+	return Result::COMPRESSED;
+}
+
+/* Streams the file through deflate in chunks */
+bool Precompressor::deflateFile(std::ifstream& in, std::ofstream& out, size_t& bytesOut)
+{
+	GzipStream gzip(_level);
+	std::vector<char> input(_chunkSize);
+	std::string output;
+
+	while (in.read(input.data(), input.size()) || in.gcount() > 0)
+	{
+		gzip.update(input.data(), in.gcount(), output);
+		out.write(output.data(), output.size());
+		bytesOut += output.size();
+		output.clear();
+	}
+	if (in.bad())
+		return false;
+	gzip.finish(output);
+	out.write(output.data(), output.size());
+	bytesOut += output.size();
+	return out.good();
+}
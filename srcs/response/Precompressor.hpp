@@ -0,0 +1,59 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Precompressor.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/09 13:42:17 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/11 15:06:44 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+#pragma once
+
+#include "../config/Config.hpp"
+#include "../utils/Utility.hpp"
+#include "../utils/logUtils.hpp"
+#include "Response.hpp"
+#include "GzipStream.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio> // rename(), remove()
+#include <cstdlib>
+#include <cstring> // strerror()
+#include <sys/stat.h> // stat()
+
+/**
+ * Offline mode, `webserv --precompress <config>`: writes a gzip sibling next
+ * to every text file under the location roots, so the server can send x.css.gz
+ * instead of x.css to the clients accepting gzip
+ */
+class Precompressor
+{
+	private:
+		enum class Result
+		{
+			COMPRESSED,
+			UP_TO_DATE,
+			NOT_SMALLER,
+			FAILED
+		};
+
+		static constexpr int				_level = Z_BEST_COMPRESSION;
+		static constexpr size_t				_chunkSize = 64 * 1024;
+
+		Precompressor() = delete;
+
+		static std::vector<std::string>		collectFiles(const Config& config);
+		static Result						compressFile(const std::string& filePath, size_t& bytesIn, size_t& bytesOut);
+		static bool							deflateFile(std::ifstream& in, std::ofstream& out, size_t& bytesOut);
+
+	public:
+		static int							run(const std::string& configFile, const char* argv0);
+};
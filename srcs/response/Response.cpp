@@ -6,98 +6,63 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:08:46 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/13 10:49:19 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/09/23 11:26:48 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "Response.hpp"
 #include "../config/Config.hpp"
 
-// https://developer.mozilla.org/en-US/docs/Web/HTTP/Status
-
-static const std::string serverName = "webserv";
-static const std::string charset = "; charset=UTF-8";
-static const std::map<int, std::string> statusMessages = {
-	{200, "OK"},
-	{201, "Created"},
-	{204, "No Content"},
-	{307, "Temporary Redirect"},
-	{400, "Bad Request"},
-	{403, "Forbidden"},
-	{404, "Not Found"},
-	{405, "Method Not Allowed"}, // if the location does not allowes method in request. Then put "Allowed: GET, POST" in response header
-	{411, "Length Required"}, // Content-Length not provided
-	{413, "Payload Too Large"}, // if the request body size exceeds the clientMaxBodySize
-	{500, "Internal Server Error"}, // can be used when the server runs into unexpected issues processing the request, including memory allocation failures
-	{502, "Bad Gateway"},
-	{504, "Gateway Timeout"},
-	{505, "HTTP Version Not Supported"}
-};
-
-static const std::map<std::string, std::string> mimeTypes = {
-	{"html", "text/html" + charset},
-	{"htm", "text/html" + charset},
-	{"css", "text/css" + charset},
-	{"js", "application/javascript" + charset},
-
-	{"ttf", "font/ttf"},
-	{"woff", "font/woff"},
-	{"woff2", "font/woff2"},
-
-	{"jpg", "image/jpeg"},
-	{"jpeg", "image/jpeg"},
-	{"png", "image/png"},
-	{"gif", "image/gif"},
-	{"svg", "image/svg+xml"},
-	{"ico",	"image/x-icon"},
-	{"bmp", "image/bmp"},
-	{"tiff", "image/tiff"},
-	{"webp", "image/webp"},
-
-	{"mp3", "audio/mpeg"},
-	{"wav", "audio/wav"},
-	{"ogg", "audio/ogg"},
-
-	{"mp4", "video/mp4"},
-	{"webm", "video/webm"},
-	{"ogg", "video/ogg"},
-
-	{"txt", "text/plain" + charset},
-	{"sitemap", "application/xml" + charset},
-	{"json", "application/json" + charset},
-	{"xml", "application/xml" + charset},
-	{"csv", "text/csv" + charset},
-	{"markdown", "text/markdown" + charset},
-	{"pdf", "application/pdf"},
-	{"zip", "application/zip"},
-	{"gzip", "application/gzip"},
-
-	// https://stackoverflow.com/questions/20508788/do-i-need-content-type-application-octet-stream-for-file-download
-	{"default", "application/octet-stream"}
-};
+// Text formats served from a precompressed .gz sibling when there is one
+static constexpr std::string_view precompressibleFormats[] = {"html", "htm", "css", "js", "json", "svg"};
+
+/* Extension of the file name, empty when there is none */
+static std::string_view findExtension(const std::string& filePath)
+{
+	size_t dotPos = filePath.find_last_of(".");
+
+	return dotPos == std::string::npos ? std::string_view() : std::string_view(filePath).substr(dotPos + 1);
+}
 
 Response::Response() {}
 
+/**
+ * Error and default pages come from the ones read when the config was loaded,
+ * the body is shared. The disk is only looked at when a page could not be read
+ * then, to answer with the last resort body
+ */
 Response::Response(int code, ServerConfig* serverConfig, std::map<std::string, std::string> optionalHeaders)
 {
-	std::string errorPagePath = serverConfig->defaultPages[404]; // fallback for not legit error codes
-	if (code >= 300 && code <= 399)
-		errorPagePath = "";
-	auto errorIt = serverConfig->errorPages.find(code);
-	auto defaultIt = serverConfig->defaultPages.find(code);
-	if (errorIt != serverConfig->errorPages.end() && access(errorIt->second.c_str(), R_OK) == 0)
+	if (code >= 300 && code <= 399) // 3XX Status request does not require body
 	{
-		errorPagePath = serverConfig->errorPages[code];
+		*this = Response(code, "", optionalHeaders);
+		return ;
 	}
-	else if (defaultIt != serverConfig->defaultPages.end())
+	auto page = serverConfig->compiledPages.find(code);
+	if (page == serverConfig->compiledPages.end() && !serverConfig->defaultPages.count(code)
+		&& !serverConfig->errorPages.count(code))
+		page = serverConfig->compiledPages.find(404); // fallback for not legit error codes
+	if (page == serverConfig->compiledPages.end())
 	{
-		LOG_DEBUG(TEXT_GREEN, "default page found", RESET);
-		errorPagePath = serverConfig->defaultPages[code];
+		auto defaultIt = serverConfig->defaultPages.find(code);
+		*this = Response(code, defaultIt != serverConfig->defaultPages.end()
+			? defaultIt->second : serverConfig->defaultPages[404], optionalHeaders);
+		return ;
 	}
-	*this = Response(code, errorPagePath, optionalHeaders);
+	if (optionalHeaders.size() > 0)
+		_headers.insert(optionalHeaders.begin(), optionalHeaders.end());
+	setStatusFromCode(code);
+	_body = page->second.body;
+	setType(page->second.type);
+	setContentLength(_body->size());
 }
 
-Response::Response(int code, std::string filePath, std::map<std::string, std::string> optionalHeaders)
+/**
+ * Regular files of sendfileThreshold bytes or more are not read, they are sent
+ * from an open fd. Smaller ones are taken from the file cache when it is on
+ */
+Response::Response(int code, std::string filePath, std::map<std::string, std::string> optionalHeaders,
+	size_t sendfileThreshold)
 {
 	if (optionalHeaders.size() > 0)
 		_headers.insert(optionalHeaders.begin(), optionalHeaders.end());
@@ -122,34 +87,71 @@ Response::Response(int code, std::string filePath, std::map<std::string, std::st
 		size = fileContent.size();
 
 
+		struct stat fileStat;
 		if (access(filePath.c_str(), R_OK) == 0)
 		{
-			LOG_DEBUG("Utility::readBinaryFile() called");
-			auto [binaryFile, binarySize] = Utility::readBinaryFile(filePath);
-			LOG_DEBUG("Utility::readBinaryFile() finished");
-			size = binarySize;
-			fileContent = std::string(binaryFile.begin(), binaryFile.end());
-
-			size_t dotPos = filePath.find_last_of(".");
-
-			if (dotPos != std::string::npos && mimeTypes.find(filePath.substr(filePath.find_last_of(".") + 1)) != mimeTypes.end())
-				setType(mimeTypes.at(filePath.substr(filePath.find_last_of(".") + 1)));
+			if (stat(filePath.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode)
+				&& static_cast<size_t>(fileStat.st_size) >= sendfileThreshold)
+			{
+				_file = FileBody::open(filePath);
+				size = _file->getSize();
+			}
+			else if (std::shared_ptr<const FileCache::Entry> cached = FileCache::load(filePath))
+			{
+				_body = cached->content;
+				setType(cached->type);
+				setContentLength(_body->size());
+				return ;
+			}
 			else
-				setType(mimeTypes.at("default"));
+			{
+				LOG_DEBUG("Utility::readBinaryFile() called");
+				fileContent = Utility::readBinaryFile(filePath);
+				LOG_DEBUG("Utility::readBinaryFile() finished");
+				size = fileContent.size();
+			}
+
+			setType(findType(filePath));
 		}
 	}
-	setBody(fileContent);
+	if (!_file)
+		setBody(std::move(fileContent));
 	setContentLength(size);
 }
 
-std::string& Response::getBody()
+/* The cached buffer is shared, not copied */
+Response::Response(int code, std::shared_ptr<const FileCache::Entry> file, std::map<std::string, std::string> optionalHeaders)
+{
+	if (optionalHeaders.size() > 0)
+		_headers.insert(optionalHeaders.begin(), optionalHeaders.end());
+	setStatusFromCode(code);
+	_body = file->content;
+	setType(file->type);
+	setContentLength(_body->size());
+	if (!file->etag.empty())
+		_headers["ETag"] = file->etag;
+	if (!file->lastModified.empty())
+		_headers["Last-Modified"] = file->lastModified;
+}
+
+const std::string& Response::getBody()
+{
+	return *_body;
+}
+
+std::shared_ptr<FileBody> Response::getFile()
+{
+	return _file;
+}
+
+std::string_view Response::getStatus() const
 {
-	return _body;
+	return HeaderWriter::status(_code);
 }
 
-std::string& Response::getStatus()
+int Response::getStatusCode() const
 {
-	return _status;
+	return _code;
 }
 
 std::string& Response::getType()
@@ -157,29 +159,43 @@ std::string& Response::getType()
 	return _type;
 }
 
-int Response::getContentLength() const
+uint64_t Response::getContentLength() const
 {
 	return _contentLength;
 }
 
+/* Size of the whole body, in memory or in the file */
+size_t Response::getBodySize() const
+{
+	return _file ? _file->getSize() : _body->size();
+}
+
+/* Empty when the header is not set, a missing header is not added */
 std::string Response::getHeader(const std::string& key)
 {
-	return _headers[key];
+	auto header = _headers.find(key);
+
+	return header != _headers.end() ? header->second : "";
 }
 
+/* A new buffer is made, a chain still holding the old body keeps sending it unchanged */
 void Response::setBody(std::string body)
 {
-	_body = body;
+	setBody(std::make_shared<const std::string>(std::move(body)));
 }
 
-void Response::setStatus(std::string status)
+/* The buffer replaces the body and the file the body was to be sent from */
+void Response::setBody(std::shared_ptr<const std::string> body)
 {
-	_status = status;
+	_body = std::move(body);
+	_file = nullptr;
 }
 
+/* Throws std::out_of_range for a code without a status line */
 void Response::setStatusFromCode(int code)
 {
-	_status = std::to_string(code) + " " + statusMessages.at(code);
+	HeaderWriter::statusLine(code);
+	_code = code;
 }
 
 void Response::setType(std::string type)
@@ -187,62 +203,197 @@ void Response::setType(std::string type)
 	_type = type;
 }
 
+/* MIME type from the file extension, application/octet-stream when it is unknown */
+std::string Response::findType(const std::string& filePath)
+{
+	return std::string(HeaderWriter::mimeType(findExtension(filePath)));
+}
+
+/* Strong validator of the file's contents, changes with any write or replacement of the file */
+std::string Response::makeETag(const struct stat& fileStat)
+{
+	std::stringstream etag;
+
+	etag << std::hex << "\"" << fileStat.st_ino << "-" << fileStat.st_size << "-" << fileStat.st_mtime << "\"";
+	return etag.str();
+}
+
+bool Response::isPrecompressible(const std::string& filePath)
+{
+	std::string_view extension = findExtension(filePath);
+
+	return std::find(std::begin(precompressibleFormats), std::end(precompressibleFormats), extension)
+		!= std::end(precompressibleFormats);
+}
+
 void Response::setTypeFromFormat(std::string format)
 {
-	try
-	{
-		_type = mimeTypes.at(format);
-	}
-	catch (const std::exception& e)
-	{
-		_type = mimeTypes.at("default");
-	}
+	_type = HeaderWriter::mimeType(format);
 }
 
-void Response::setContentLength(int contentLength)
+void Response::setContentLength(uint64_t contentLength)
 {
 	_contentLength = contentLength;
 }
 
-void Response::setHeader(const std::string& key, std::string& value)
+void Response::setHeader(const std::string& key, const std::string& value)
 {
 	_headers[key] = value;
 }
 
-void Response::appendToBody(char* data, size_t length)
+/* ETag and Last-Modified of a static file, the client revalidates its copy with them */
+void Response::setValidators(const struct stat& fileStat)
+{
+	_headers["ETag"] = makeETag(fileStat);
+	_headers["Last-Modified"] = Utility::getDate(fileStat.st_mtime);
+}
+
+/**
+ * Turns the response into a 206 for the ranges, which parseRanges() checked
+ * against the body size. Several ranges go out as a multipart/byteranges body
+ */
+void Response::setRanges(std::vector<Range> ranges)
+{
+	thread_local std::mt19937_64 generator(std::random_device{}());
+	std::stringstream boundary;
+
+	setStatusFromCode(206);
+	_ranges = std::move(ranges);
+	if (_ranges.size() == 1)
+	{
+		_headers["Content-Range"] = "bytes " + std::to_string(_ranges[0].first) + "-"
+			+ std::to_string(_ranges[0].first + _ranges[0].length - 1) + "/" + std::to_string(getBodySize());
+		return ;
+	}
+	boundary << std::hex << generator();
+	_boundary = "webserv" + boundary.str();
+}
+
+/**
+ * Reads `bytes=` range specs, e.g. `0-99`, `100-` and `-50`. Returns false when
+ * the header is malformed or asks for too many parts, the Range header is then
+ * ignored. Specs starting past the end of the body are left out, an empty
+ * list means nothing of the body can be sent
+ */
+bool Response::parseRanges(const std::string& header, size_t size, std::vector<Range>& ranges)
 {
-	_body.append(data, length);
+	std::string value = Utility::trim(header);
+
+	if (Utility::strToLower(value.substr(0, 6)) != "bytes=")
+		return false;
+	std::vector<std::string> specs = Utility::splitStr(value.substr(6), ",");
+	if (specs.empty() || specs.size() > _maxRanges)
+		return false;
+
+	auto isNumber = [](const std::string& str) {
+		return !str.empty() && str.size() < 19 && std::all_of(str.begin(), str.end(), ::isdigit);
+	};
+	for (std::string spec : specs)
+	{
+		spec = Utility::trim(spec);
+		size_t dash = spec.find('-');
+		if (dash == std::string::npos)
+			return false;
+		std::string firstStr = spec.substr(0, dash);
+		std::string lastStr = spec.substr(dash + 1);
+
+		if (firstStr.empty())
+		{
+			if (!isNumber(lastStr))
+				return false;
+			size_t suffix = std::min(static_cast<size_t>(std::stoull(lastStr)), size);
+			if (suffix > 0)
+				ranges.push_back({size - suffix, suffix});
+			continue ;
+		}
+		if (!isNumber(firstStr) || (!lastStr.empty() && !isNumber(lastStr)))
+			return false;
+		size_t first = std::stoull(firstStr);
+		size_t last = lastStr.empty() ? std::numeric_limits<size_t>::max() : std::stoull(lastStr);
+		if (last < first)
+			return false;
+		if (first < size)
+			ranges.push_back({first, std::min(last, size - 1) - first + 1});
+	}
+	return true;
 }
 
-std::string Response::buildResponse(Response& response)
+/**
+ * Appends the response to the chain: the header block as a new buffer and
+ * the body as a reference to the Response's own buffer, which is not copied,
+ * or as a range of its open file
+ */
+void Response::buildResponse(Response& response, OutputChain& output, bool keepAlive)
 {
-	std::stringstream responseNew;
+	HeaderWriter header(response._code);
+
+	header.add("Date", HeaderWriter::date());
+	header.add("Server", "webserv");
+	header.add("Connection", keepAlive ? "keep-alive" : "close");
 
-	if (response.getStatus().empty())
+	// The part headers of a multipart/byteranges body, the last one closes the body
+	std::vector<std::string> parts;
+	size_t contentLength = response._ranges.empty() ? response.getBodySize() : 0;
+	for (const Range& range : response._ranges)
+	{
+		if (response._ranges.size() == 1)
+		{
+			contentLength = range.length;
+			break ;
+		}
+		std::stringstream part;
+		part << "\r\n--" << response._boundary << "\r\n";
+		if (!response.getType().empty())
+			part << "Content-Type: " << response.getType() << "\r\n";
+		part << "Content-Range: bytes " << range.first << "-" << range.first + range.length - 1
+			<< "/" << response.getBodySize() << "\r\n\r\n";
+		parts.push_back(part.str());
+		contentLength += parts.back().size() + range.length;
+	}
+	if (!parts.empty())
 	{
-		response._status = "200 OK";
+		parts.push_back("\r\n--" + response._boundary + "--\r\n");
+		contentLength += parts.back().size();
 	}
-	responseNew << "HTTP/1.1 " << response.getStatus() << "\r\n";
-	responseNew << "Date: " << Utility::getDate() << "\r\n";
-	responseNew << "Server: webserv" << "\r\n";
-	responseNew << "Connection: close" << "\r\n";
-	responseNew << "Content-Length: " << response.getBody().size() << "\r\n";
 
-	if (!response.getType().empty())
-		responseNew << "Content-Type: " << response.getType() << "\r\n";
+	// A 304 has no body, a Content-Length would describe the body of the 200 it stands for
+	if (response._code != 304)
+		header.add("Content-Length", static_cast<uint64_t>(contentLength));
+
+	if (!parts.empty())
+		header.add("Content-Type", "multipart/byteranges; boundary=" + response._boundary);
+	else if (!response.getType().empty())
+		header.add("Content-Type", response.getType());
 
 	/* Add optional headers*/
 	for (auto& [headerKey, headerValue] : response._headers)
 	{
-
-		responseNew << headerKey << ": " << headerValue << "\r\n";
+		header.add(headerKey, headerValue);
 		LOG_DEBUG("headerKey: ", headerKey, ", headerValue: ", headerValue);
 	}
-	LOG_DEBUG("response so far: ", responseNew.str());
-	responseNew << "\r\n";
+	std::string headerBlock = header.finish();
+	LOG_DEBUG("response headers: ", headerBlock);
+	output.append(std::move(headerBlock));
+
+	/* The body is sent exactly as announced in Content-Length, on a kept-alive connection
+	any extra byte would be read as the start of the next response */
+	if (response._ranges.empty())
+		response.appendBody(output, 0, response.getBodySize());
+	for (size_t i = 0; i < response._ranges.size(); i++)
+	{
+		if (!parts.empty())
+			output.append(parts[i]);
+		response.appendBody(output, response._ranges[i].first, response._ranges[i].length);
+	}
+	if (!parts.empty())
+		output.append(parts.back());
+}
 
-	/* Not adding extra line if body is empty*/
-	if (response.getBody().size() != 0)
-		responseNew << response.getBody() << "\r\n";
-	return responseNew.str();
+/* A part of the body, referenced in the buffer or the file, not copied */
+void Response::appendBody(OutputChain& output, size_t first, size_t length)
+{
+	if (_file)
+		output.append(_file, first, length);
+	else
+		output.append(_body, first, length);
 }
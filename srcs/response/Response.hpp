@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:08:51 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/07/23 18:39:41 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/09/20 14:44:10 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -15,40 +15,75 @@
 #include "../utils/Utility.hpp"
 #include "../request/Request.hpp"
 #include "../config/Config.hpp"
+#include "OutputChain.hpp"
+#include "FileBody.hpp"
+#include "FileCache.hpp"
+#include "HeaderWriter.hpp"
+#include <cstdint>
 #include <map>
+#include <limits>
+#include <memory>
+#include <random>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <sstream>
 #include <iostream>
 #include <unistd.h> // for access()
+#include <sys/stat.h> // for stat()
 
 class Response
 {
+	public:
+		struct Range
+		{
+			size_t							first;
+			size_t							length;
+		};
+
 	private:
-		std::string							_body;
-		std::string							_status;
+		std::shared_ptr<const std::string>	_body = std::make_shared<const std::string>(); // shared with the output chain and the file cache
+		std::shared_ptr<FileBody>			_file; // body sent with sendfile(), _body is then empty
+		int									_code = 200;
 		std::string							_type;
 		std::map<std::string, std::string>	_headers;
-		int									_contentLength = 0;
+		uint64_t							_contentLength = 0; // 64-bit, files may be larger than 2 GB
+		std::vector<Range>					_ranges; // parts of the body sent with 206
+		std::string							_boundary; // of the multipart/byteranges body
+
+		static constexpr size_t				_maxRanges = 16;
+
+		void								appendBody(OutputChain& output, size_t first, size_t length);
 
-		void								appendToBody(char* data, size_t length);
 	public:
 		Response();
 		Response(int code, ServerConfig* serverConfig, std::map<std::string, std::string> optionalHeaders = {});
-		Response(int code, std::string filePath, std::map<std::string, std::string> optionalHeaders = {});
+		Response(int code, std::string filePath, std::map<std::string, std::string> optionalHeaders = {},
+			size_t sendfileThreshold = std::numeric_limits<size_t>::max());
+		Response(int code, std::shared_ptr<const FileCache::Entry> file, std::map<std::string, std::string> optionalHeaders = {});
 
-		std::string&						getBody();
-		std::string&						getStatus();
+		const std::string&					getBody();
+		std::shared_ptr<FileBody>			getFile();
+		std::string_view					getStatus() const;
+		int									getStatusCode() const;
 		std::string&						getType();
 		std::string							getHeader(const std::string& key);
-		int									getContentLength() const;
+		uint64_t							getContentLength() const;
+		size_t								getBodySize() const;
 
 		void								setBody(std::string body);
-		void								setStatus(std::string status);
+		void								setBody(std::shared_ptr<const std::string> body);
 		void								setStatusFromCode(int code);
 		void								setType(std::string type);
 		void								setTypeFromFormat(std::string format);
-		void								setContentLength(int contentLength);
-		void								setHeader(const std::string& key, std::string& value);
+		void								setContentLength(uint64_t contentLength);
+		void								setHeader(const std::string& key, const std::string& value);
+		void								setValidators(const struct stat& fileStat);
+		void								setRanges(std::vector<Range> ranges);
 		
-		static std::string					buildResponse(Response& response);
+		static std::string					findType(const std::string& filePath);
+		static bool							isPrecompressible(const std::string& filePath);
+		static std::string					makeETag(const struct stat& fileStat);
+		static bool							parseRanges(const std::string& header, size_t size, std::vector<Range>& ranges);
+		static void							buildResponse(Response& response, OutputChain& output, bool keepAlive = false);
 };
@@ -6,7 +6,7 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/16 17:53:36 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/07/30 20:12:10 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -63,7 +63,9 @@ std::string Uploader::removeQuotes(const std::string& str)
 	return result;
 }
 
-size_t Uploader::processForm(std::string headers, std::string body, Location& foundLocation)
+/* The file data is copied from the request body, a spooled body never comes back to memory */
+size_t Uploader::processForm(std::string headers, const RequestBody& body, size_t offset, size_t length,
+	Location& foundLocation)
 {
 	std::istringstream stream(headers);
 	std::string line;
@@ -94,7 +96,13 @@ size_t Uploader::processForm(std::string headers, std::string body, Location& fo
 	if (!filename.empty())
 	{
 		LOG_INFO(TEXT_YELLOW, "File will be created here: ", foundLocation.root, RESET);
-		Utility::createFile(foundLocation.root + filename, body);
+		int fd = open((foundLocation.root + filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd == -1)
+			throw ServerException("Error: Could not create the file!");
+		bool isCopied = body.copyTo(fd, offset, length);
+		close(fd);
+		if (!isCopied)
+			throw ServerException("Error: Could not write the file!");
 		filesCreated++;
 	}
 	return filesCreated;
@@ -111,25 +119,28 @@ int Uploader::handleUpload(Client& client, Location& foundLocation)
 		LOG_INFO(TEXT_CYAN, "HTML Form upload...", RESET);
 		std::string boundary = findUploadFormBoundary(client);
 		LOG_DEBUG(TEXT_GREEN, boundary, RESET);
-		std::string requestBody = Utility::replaceStrInStr(client.getRequest()->getBody(), "--" + boundary + "--", "");
-		std::vector<std::string> multipartVec = Utility::splitStr(requestBody, "--" + boundary);
+		RequestBody& requestBody = client.getRequest()->getBody();
+		std::string delimiter = "--" + boundary;
+		size_t delimiterPos = requestBody.find(delimiter);
 
-		for (std::string& part : multipartVec)
+		while (delimiterPos != std::string::npos)
 		{
-			LOG_DEBUG(TEXT_GREEN, part, RESET);
+			size_t partStart = delimiterPos + delimiter.size();
+			if (requestBody.read(partStart, 2) == "--") // closing delimiter
+				break;
+			delimiterPos = requestBody.find(delimiter, partStart);
+			size_t partEnd = delimiterPos == std::string::npos ? requestBody.size() : delimiterPos;
 
-			size_t emptyLinePos = part.find("\r\n\r\n");
+			size_t emptyLinePos = requestBody.find("\r\n\r\n", partStart, partEnd);
 			if (emptyLinePos == std::string::npos)
 				continue;
 			size_t emptyLinesSize = 4;
 
-			std::string headers = part.substr(0, emptyLinePos);
-			std::string body = emptyLinePos + emptyLinesSize != part.size() ? 
-								part.substr(emptyLinePos + emptyLinesSize) :
-								"";
+			std::string headers = requestBody.read(partStart, emptyLinePos - partStart);
+			size_t bodyStart = emptyLinePos + emptyLinesSize;
 
-			LOG_DEBUG("body: \n", body);
-			filesCreated += processForm(headers, body, foundLocation);
+			LOG_DEBUG("body bytes: ", partEnd - bodyStart);
+			filesCreated += processForm(headers, requestBody, bodyStart, partEnd - bodyStart, foundLocation);
 		}
 	}
 	if (filesCreated)
@@ -6,7 +6,7 @@
 /*   By: ixu <ixu@student.hive.fi>                  +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/16 17:53:36 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/06 17:47:11 by ixu              ###   ########.fr       */
+/*   Updated: 2024/10/02 15:42:07 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -16,6 +16,9 @@
 #include <string>
 #include "../config/Config.hpp"
 #include "../response/Response.hpp"
+#include "../request/RequestBody.hpp"
+#include <fcntl.h> // open()
+#include <unistd.h> // close()
 
 class Uploader
 {
@@ -23,7 +26,8 @@ class Uploader
 		static std::string	extractFromMultiValue(std::string value, std::string field);
 		static std::string	findUploadFormBoundary(Client& client);
 		static std::string	removeQuotes(const std::string& str);
-		static size_t		processForm(std::string headers, std::string body, Location& foundLocation);
+		static size_t		processForm(std::string headers, const RequestBody& body, size_t offset, size_t length,
+								Location& foundLocation);
 
 	public:
 		static int			handleUpload(Client& client, Location& foundLocation);
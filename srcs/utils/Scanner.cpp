@@ -0,0 +1,150 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Scanner.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/27 16:08:55 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/30 13:21:40 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "Scanner.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define SCANNER_X86
+#endif
+
+static size_t searchScalar(const char* data, size_t length, const char* needle, size_t needleLength)
+{
+	return std::string_view(data, length).find(std::string_view(needle, needleLength));
+}
+
+#ifdef SCANNER_X86
+
+/**
+ * The first and the last byte of the needle are compared at every position of
+ * a block at once, only positions where both match are compared in full
+ */
+__attribute__((target("sse2")))
+static size_t searchSSE2(const char* data, size_t length, const char* needle, size_t needleLength)
+{
+	const __m128i	first = _mm_set1_epi8(needle[0]);
+	const __m128i	last = _mm_set1_epi8(needle[needleLength - 1]);
+	size_t			i = 0;
+
+	for (; i + needleLength - 1 + 16 <= length; i += 16)
+	{
+		__m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + needleLength - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+			_mm_cmpeq_epi8(blockLast, last)));
+		while (mask != 0)
+		{
+			size_t bit = __builtin_ctz(mask);
+			if (std::memcmp(data + i + bit + 1, needle + 1, needleLength - 2) == 0)
+				return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	size_t found = searchScalar(data + i, length - i, needle, needleLength);
+	return found == std::string::npos ? found : i + found;
+}
+
+__attribute__((target("avx2")))
+static size_t searchAVX2(const char* data, size_t length, const char* needle, size_t needleLength)
+{
+	const __m256i	first = _mm256_set1_epi8(needle[0]);
+	const __m256i	last = _mm256_set1_epi8(needle[needleLength - 1]);
+	size_t			i = 0;
+
+	for (; i + needleLength - 1 + 32 <= length; i += 32)
+	{
+		__m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		__m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + needleLength - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+			_mm256_cmpeq_epi8(blockLast, last)));
+		while (mask != 0)
+		{
+			size_t bit = __builtin_ctz(mask);
+			if (std::memcmp(data + i + bit + 1, needle + 1, needleLength - 2) == 0)
+				return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	_mm256_zeroupper();
+	size_t found = searchSSE2(data + i, length - i, needle, needleLength);
+	return found == std::string::npos ? found : i + found;
+}
+
+static Scanner::Path detectPath()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return Scanner::Path::AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return Scanner::Path::SSE2;
+	return Scanner::Path::SCALAR;
+}
+
+Scanner::Path				Scanner::_path = detectPath();
+Scanner::Search				Scanner::_search = _path == Path::AVX2 ? searchAVX2
+								: _path == Path::SSE2 ? searchSSE2 : searchScalar;
+
+#else
+
+Scanner::Path				Scanner::_path = Scanner::Path::SCALAR;
+Scanner::Search				Scanner::_search = searchScalar;
+
+#endif
+
+/* memchr() of the C library already picks its SSE2 or AVX2 version at load time, it is the fastest for one byte */
+size_t Scanner::find(std::string_view data, char c, size_t from)
+{
+	if (from >= data.size())
+		return std::string::npos;
+	const void* found = std::memchr(data.data() + from, c, data.size() - from);
+	return found ? static_cast<const char*>(found) - data.data() : std::string::npos;
+}
+
+/* Needles of one byte are looked for as a byte, an empty one is found where the search starts */
+size_t Scanner::find(std::string_view data, std::string_view needle, size_t from)
+{
+	if (needle.size() == 1)
+		return find(data, needle[0], from);
+	if (needle.empty())
+		return from <= data.size() ? from : std::string::npos;
+	if (from > data.size() || data.size() - from < needle.size())
+		return std::string::npos;
+	size_t found = _search(data.data() + from, data.size() - from, needle.data(), needle.size());
+	return found == std::string::npos ? found : from + found;
+}
+
+/* Spaces and tabs around a header value, the optional whitespace of HTTP */
+std::string_view Scanner::trim(std::string_view data)
+{
+	size_t first = data.find_first_not_of(" \t");
+	if (first == std::string_view::npos)
+		return std::string_view();
+	return data.substr(first, data.find_last_not_of(" \t") - first + 1);
+}
+
+Scanner::Path Scanner::getPath()
+{
+	return _path;
+}
+
+const char* Scanner::getPathName()
+{
+	switch (_path)
+	{
+		case Path::AVX2:
+			return "AVX2";
+		case Path::SSE2:
+			return "SSE2";
+		default:
+			return "scalar";
+	}
+}
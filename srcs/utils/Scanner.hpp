@@ -0,0 +1,50 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Scanner.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/09/27 16:08:55 by dnikifor          #+#    #+#             */
+/*   Updated: 2024/09/30 13:21:40 by dnikifor         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+
+#include <cstring> // memchr(), memcmp()
+#include <string>
+#include <string_view>
+
+/**
+ * Finds delimiters in request bytes. Multi-byte delimiters such as multipart
+ * boundaries are searched 32 or 16 positions at a time, with the widest path
+ * the CPU has, picked once at startup with cpuid: AVX2, SSE2 or a plain loop.
+ * Results are offsets into data, or std::string::npos as with std::string::find
+ */
+class Scanner
+{
+	public:
+		enum class Path
+		{
+			SCALAR,
+			SSE2,
+			AVX2
+		};
+
+	private:
+		typedef size_t (*Search)(const char* data, size_t length, const char* needle, size_t needleLength);
+
+		static Path					_path;
+		static Search				_search;
+
+		Scanner() = delete;
+
+	public:
+		static size_t				find(std::string_view data, char c, size_t from = 0);
+		static size_t				find(std::string_view data, std::string_view needle, size_t from = 0);
+		static std::string_view		trim(std::string_view data);
+
+		static Path					getPath();
+		static const char*			getPathName();
+};
@@ -6,36 +6,29 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/28 19:35:22 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/06 15:15:34 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "Signals.hpp"
 
-void Signals::killAllChildrenPids()
-{
-	for (auto pid : g_childPids)
-	{
-		if (pid > 0)
-		{
-			std::cout << TEXT_WHITE << "\n[" << getCurrentTime() << "] " << RESET;
-			std::cout << TEXT_MAGENTA << "[INFO] " << RESET;
-			std::cout << TEXT_MAGENTA << "Terminating the child process with pid [" << pid << "]" << RESET;
-			kill(pid, SIGTERM);
-		}
-	}
-}
-
 void Signals::signalHandler(int signal)
 {
 	LOG_DEBUG("Signal ", signal, " received");
+	// Event loops stop on their next wake-up, CGI scripts and workers are stopped by their owners
 	g_signalReceived.store(true);
-	killAllChildrenPids();
 	std::cout << TEXT_WHITE << "\n[" << getCurrentTime() << "] " << RESET;
 	std::cout << TEXT_MAGENTA << "[INFO] " << RESET;
 	std::cout << TEXT_MAGENTA << "Shutting down the server(s)..." << RESET << std::endl;
 }
 
+/* Counters are logged by an event loop on its next wake-up, the master forwards the signal to its workers */
+void Signals::statsHandler(int signal)
+{
+	(void)signal;
+	g_statsRequested.store(true);
+}
+
 void Signals::trackSignals()
 {
 	signal(SIGINT, signalHandler); /* ctrl + c */
@@ -43,4 +36,5 @@ void Signals::trackSignals()
 	signal(SIGQUIT, signalHandler); /* ctrl + \ */
 	signal(SIGTERM, signalHandler); /* kill -15 pid */
 	signal(SIGPIPE, SIG_IGN); /* cancelling request */
+	signal(SIGUSR1, statsHandler); /* kill -USR1 pid logs the file cache counters */
 }
@@ -6,7 +6,7 @@
 /*   By: vshchuki <vshchuki@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/28 19:35:24 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/01 17:02:14 by vshchuki         ###   ########.fr       */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -26,8 +26,8 @@ class Signals
 {
 	private:
 		static void signalHandler(int signal);
+		static void statsHandler(int signal);
 		
 	public:
 		static void trackSignals();
-		static void killAllChildrenPids();
 };
\ No newline at end of file
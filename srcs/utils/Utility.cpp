@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:11:23 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/08/13 10:49:53 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/09/13 10:52:38 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -111,18 +111,41 @@ std::string Utility::readFile(std::string filePath)
 // Date: Sun, 18 Oct 2012 10:36:20 GMT
 std::string Utility::getDate()
 {
-	time_t rawtime;
-	struct tm *timeinfo;
+	return getDate(time(nullptr));
+}
+
+/* HTTP date (IMF-fixdate) of the time */
+std::string Utility::getDate(time_t rawtime)
+{
+	struct tm timeinfo;
 	char buffer[80];
 
-	time(&rawtime);
-	timeinfo = gmtime(&rawtime);
+	gmtime_r(&rawtime, &timeinfo); // gmtime() shares one buffer between threads
 
-	strftime(buffer, 80, "%a, %d %b %Y %H:%M:%S GMT", timeinfo);
+	strftime(buffer, 80, "%a, %d %b %Y %H:%M:%S GMT", &timeinfo);
 
 	return std::string(buffer);
 }
 
+/* Reads an HTTP date as written by getDate(), false when the string is not one */
+bool Utility::parseDate(const std::string& date, time_t& result)
+{
+	struct tm timeinfo = {};
+	const char* end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &timeinfo);
+
+	if (end == nullptr || *end != '\0')
+		return false;
+	result = timegm(&timeinfo);
+	return true;
+}
+
+/* Used for `auto` in workers and threads, falls back to 1 if the number can not be read */
+int Utility::countOnlineCpus()
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
 std::string	Utility::replaceStrInStr(std::string dest, const std::string& str1, const std::string& str2)
 {
 	return std::regex_replace(dest, std::regex(str1), str2);
@@ -139,7 +162,7 @@ std::string Utility::readLine(std::istream &stream)
 	return line;
 }
 
-std::pair<std::vector<uint8_t>, size_t> Utility::readBinaryFile(const std::string& filePath)
+std::string Utility::readBinaryFile(const std::string& filePath)
 {
 	// Open the file in binary mode at the end to get the file size
 	std::ifstream file(filePath, std::ios::binary | std::ios::ate);
@@ -152,15 +175,38 @@ std::pair<std::vector<uint8_t>, size_t> Utility::readBinaryFile(const std::strin
 	std::streamsize size = file.tellg();
 	file.seekg(0, std::ios::beg);
 
-	// Read the contents of the file into a vector
-	std::vector<uint8_t> buffer(size);
-	if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
+	// Read the contents of the file straight into the string the body is kept in
+	std::string buffer(size, '\0');
+	if (!file.read(buffer.data(), size)) {
 		throw ProcessingError(500, {}, "Exception (reading error) has been thrown in readBinaryFile() "
 			"method of Utility class");
 	}
 
-	return {buffer, static_cast<size_t>(size)};
+	return buffer;
+}
+/* Size from the config, with an optional G, M, K or B suffix */
+size_t Utility::sizeToBytes(const std::string& sizeString)
+{
+	size_t multiplier = 1;
+	size_t numericValue = std::stoull(sizeString);
+
+	switch (std::toupper(sizeString.back()))
+	{
+	case 'G':
+		multiplier *= 1024;
+		[[fallthrough]];
+	case 'M':
+		multiplier *= 1024;
+		[[fallthrough]];
+	case 'K':
+		multiplier *= 1024;
+		[[fallthrough]];
+	default:
+		break;
+	}
+	return numericValue * multiplier;
 }
+
 void Utility::createFile(std::string filename, std::string content)
 {
 	std::ofstream outFile(filename);
@@ -187,6 +233,7 @@ bool Utility::argvCheck(int argc, char *argv[], std::string& configFile)
 	{
 		LOG_ERROR("Too many arguments");
 		LOG_INFO("Usage: ./webserv <config>");
+		LOG_INFO("       ./webserv --precompress <config>");
 		LOG_INFO("<config> - absolute path or relative path to the executable directory");
 		return true;
 	}
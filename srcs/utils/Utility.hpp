@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/01 19:11:26 by vshchuki          #+#    #+#             */
-/*   Updated: 2024/07/28 20:33:58 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/09/13 10:52:38 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -22,6 +22,7 @@
 
 #include <cstring>
 #include <ctime>
+#include <unistd.h> // sysconf()
 
 #include <utility> // For std::pair
 #include <stdint.h> // for uint8_t
@@ -42,9 +43,13 @@ class Utility
 		static std::string								strToUpper(std::string str);
 		static std::string								readFile(std::string filePath);
 		static std::string								getDate();
+		static std::string								getDate(time_t rawtime);
+		static bool										parseDate(const std::string& date, time_t& result);
+		static int										countOnlineCpus();
 		static std::string								replaceStrInStr(std::string dest, const std::string& str1, const std::string& str2);
 		static std::string								readLine(std::istream &stream);
-		static std::pair<std::vector<uint8_t>, size_t>	readBinaryFile(const std::string& filePath);
+		static std::string								readBinaryFile(const std::string& filePath);
+		static size_t									sizeToBytes(const std::string& sizeString);
 		static void										createFile(std::string filename, std::string content);
 		static bool										argvCheck(int argc, char *argv[], std::string& configFile);
 };
@@ -6,7 +6,7 @@
 /*   By: dnikifor <dnikifor@student.hive.fi>        +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/07/19 17:16:12 by dnikifor          #+#    #+#             */
-/*   Updated: 2024/08/13 10:45:35 by dnikifor         ###   ########.fr       */
+/*   Updated: 2024/09/06 16:21:50 by dnikifor         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -15,7 +15,6 @@
 #include <vector>
 #include <atomic>
 
-extern std::vector<pid_t>	g_childPids;
 extern std::atomic<bool>	g_signalReceived;
-extern const size_t			g_bufferSize;
-extern const float			g_timeout;
\ No newline at end of file
+extern std::atomic<bool>	g_statsRequested;
+extern const size_t			g_bufferSize;
\ No newline at end of file